@@ -0,0 +1,542 @@
+// ##################################################################################################################
+/*
+ * Benchmark suite for libdes: per-stage ns/block and cycles/byte for every engine, buffer sizes, thread counts
+ * and whole files. Results are printed as CSV (default) or JSON, one row per measurement:
+ *
+ *      stage, engine, bytes, threads, ns_per_block, cycles_per_byte, mb_per_s
+ *
+ * bytes is the amount of data per call (8 for the single-block stages), cycles are TSC cycles (0 off x86).
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "des_internal.h"
+
+#define MAX_BENCH_THREADS 256
+
+
+// ##################################################################################################################
+// Function Prototypes
+// ##################################################################################################################
+
+// command line
+typedef struct {
+    char json;                  // JSON instead of CSV
+    double min_time;            // seconds each measurement runs for at least
+    uint64_t max_size;          // largest buffer and file size
+    unsigned int threads;       // largest thread count
+} bench_options;
+
+int parse_bench_options(int argc, char **argv, bench_options *opts);
+
+// timing
+typedef struct {
+    struct timespec start;
+    uint64_t start_cycles;
+} bench_timer;
+
+uint64_t read_cycles(void);
+
+void start_timer(bench_timer *timer);
+
+void stop_timer(const bench_timer *timer, double *ns, double *cycles);
+
+unsigned int next_thread_count(unsigned int threads);
+
+uint64_t next_size(uint64_t size);
+
+// reporting
+void report(const char *stage, const char *engine, uint64_t bytes, unsigned int threads, uint64_t blocks, double ns,
+            double cycles);
+
+// benchmarks
+void bench_stages(void);
+
+void bench_engines(void);
+
+void bench_key_agile(void);
+
+void bench_streams(void);
+
+void bench_hex(void);
+
+void bench_buffers(void);
+
+int bench_files(void);
+
+// ##################################################################################################################
+
+bench_options options;
+unsigned int rows = 0;
+volatile uint64_t sink;
+
+const char *engine_names[] = {"avx512", "avx2", "sse2", "bitslice", "table"};
+const char *hex_codec_names[] = {"avx2", "ssse3", "scalar"};
+
+// ##################################################################################################################
+// Main Function
+// ##################################################################################################################
+
+int main(int argc, char **argv) {
+    if (parse_bench_options(argc, argv, &options) != 0)
+        return 1;
+
+    // des_init builds the tables and selects the engines
+    des_ctx ctx;
+    uint64_t key = 0x133457799BBCDFF1;
+    des_init(&ctx, &key, 1, DES_MODE_ECB, 0);
+
+    if (options.json)
+        printf("[\n");
+    else
+        printf("stage,engine,bytes,threads,ns_per_block,cycles_per_byte,mb_per_s\n");
+
+    bench_stages();
+    bench_engines();
+    bench_key_agile();
+    bench_streams();
+    bench_hex();
+    bench_buffers();
+    int status = bench_files();
+
+    if (options.json)
+        printf("\n]\n");
+    return status;
+}
+
+// ##################################################################################################################
+
+
+// ##################################################################################################################
+// Function Definitions
+// ##################################################################################################################
+
+
+int parse_bench_options(int argc, char **argv, bench_options *opts) {
+    static const struct option long_options[] = {
+            {"format", required_argument, NULL, 'f'},
+            {"time", required_argument, NULL, 't'},
+            {"max-size", required_argument, NULL, 's'},
+            {"threads", required_argument, NULL, 'j'},
+            {NULL, 0, NULL, 0}
+    };
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->json = 0;
+    opts->min_time = 0.2;
+    opts->max_size = (uint64_t)64 << 20;
+    opts->threads = cores > 0 ? cores : 1;
+
+    int option;
+    char usage = 0;
+    while ((option = getopt_long(argc, argv, "f:t:s:j:", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'f':
+                opts->json = strcmp(optarg, "json") == 0;
+                if (!opts->json && strcmp(optarg, "csv") != 0)
+                    usage = 1;
+                break;
+            case 't':
+                opts->min_time = strtod(optarg, NULL);
+                if (opts->min_time <= 0)
+                    usage = 1;
+                break;
+            case 's': {
+                // Accepts K, M and G suffixes (powers of 1024)
+                char *end;
+                opts->max_size = strtoull(optarg, &end, 10);
+                if (*end == 'K' || *end == 'k')
+                    opts->max_size <<= 10;
+                else if (*end == 'M' || *end == 'm')
+                    opts->max_size <<= 20;
+                else if (*end == 'G' || *end == 'g')
+                    opts->max_size <<= 30;
+                if (opts->max_size < 8)
+                    usage = 1;
+                break;
+            }
+            case 'j':
+                opts->threads = strtoul(optarg, NULL, 10);
+                if (opts->threads < 1 || opts->threads > MAX_BENCH_THREADS)
+                    usage = 1;
+                break;
+            default:
+                usage = 1;
+                break;
+        }
+    }
+
+    if (usage || optind != argc) {
+        fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  -f, --format csv|json    output format (default: csv)\n");
+        fprintf(stderr, "  -t, --time SECONDS       minimum time per measurement (default: 0.2)\n");
+        fprintf(stderr, "  -s, --max-size BYTES     largest buffer and file, K/M/G suffixes allowed (default: 64M)\n");
+        fprintf(stderr, "  -j, --threads N          largest thread count (default: all cores)\n");
+        return 1;
+    }
+    return 0;
+}
+
+uint64_t read_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+void start_timer(bench_timer *timer) {
+    clock_gettime(CLOCK_MONOTONIC, &timer->start);
+    timer->start_cycles = read_cycles();
+}
+
+void stop_timer(const bench_timer *timer, double *ns, double *cycles) {
+    struct timespec now;
+    uint64_t now_cycles = read_cycles();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    *ns = (now.tv_sec - timer->start.tv_sec) * 1e9 + (now.tv_nsec - timer->start.tv_nsec);
+    *cycles = (double)(now_cycles - timer->start_cycles);
+}
+
+unsigned int next_thread_count(unsigned int threads) {
+    // Powers of two, then the largest count itself
+    if (threads >= options.threads)
+        return options.threads + 1;
+    return threads * 2 < options.threads ? threads * 2 : options.threads;
+}
+
+uint64_t next_size(uint64_t size) {
+    // Steps of x64, then the largest size itself (whole blocks)
+    uint64_t largest = options.max_size & ~(uint64_t)7;
+    if (size >= largest)
+        return options.max_size + 1;
+    return size * 64 < largest ? size * 64 : largest;
+}
+
+void report(const char *stage, const char *engine, uint64_t bytes, unsigned int threads, uint64_t blocks, double ns,
+            double cycles) {
+    double ns_per_block = ns / blocks;
+    double cycles_per_byte = cycles / (blocks * 8.0);
+    double mb_per_s = blocks * 8.0 / ns * 1e3;
+
+    if (options.json) {
+        printf("%s  {\"stage\": \"%s\", \"engine\": \"%s\", \"bytes\": %" PRIu64 ", \"threads\": %u, "
+               "\"ns_per_block\": %.3f, \"cycles_per_byte\": %.3f, \"mb_per_s\": %.3f}",
+               rows == 0 ? "" : ",\n", stage, engine, bytes, threads, ns_per_block, cycles_per_byte, mb_per_s);
+    } else {
+        printf("%s,%s,%" PRIu64 ",%u,%.3f,%.3f,%.3f\n", stage, engine, bytes, threads, ns_per_block, cycles_per_byte,
+               mb_per_s);
+    }
+    rows++;
+    fflush(stdout);
+}
+
+// Runs the body (which handles step blocks per pass) until options.min_time has passed, then reports it
+#define MEASURE(stage, engine, bytes, threads, step, ...)                                   \
+    do {                                                                                    \
+        bench_timer timer;                                                                  \
+        double measured_ns = 0, measured_cycles = 0;                                        \
+        uint64_t measured_blocks = 0;                                                       \
+        start_timer(&timer);                                                                \
+        while (measured_ns < options.min_time * 1e9) {                                      \
+            for (unsigned int pass = 0; pass < 16; pass++) {                                \
+                __VA_ARGS__;                                                                \
+            }                                                                               \
+            measured_blocks += 16 * (uint64_t)(step);                                       \
+            stop_timer(&timer, &measured_ns, &measured_cycles);                             \
+        }                                                                                   \
+        report(stage, engine, bytes, threads, measured_blocks, measured_ns, measured_cycles);  \
+    } while (0)
+
+void bench_stages(void) {
+    uint64_t keys[16];
+    des_generate_keys(0x133457799BBCDFF1, keys);
+
+    // Every call feeds on the previous result so nothing can be hoisted out of the loop
+    uint64_t x = 0x0123456789ABCDEF;
+    MEASURE("initial_permutation", "reference", 8, 1, 1, des_initial_permutation(x, &x));
+    MEASURE("initial_permutation", "table", 8, 1, 1, des_initial_permutation_fast(x, &x));
+    MEASURE("s_box", "reference", 8, 1, 1, des_s_box(x & 0xFFFFFFFFFFFF, &x));
+    MEASURE("f_function", "reference", 8, 1, 1, des_f_function(x & 0xFFFFFFFF, keys[pass], &x));
+    MEASURE("f_function", "table", 8, 1, 1, des_f_function_fast(x & 0xFFFFFFFF, keys[pass], &x));
+    MEASURE("generate_keys", "reference", 8, 1, 1, des_generate_keys_reference(x ^ keys[15], keys));
+    MEASURE("generate_keys", "table", 8, 1, 1, des_generate_keys(x ^ keys[15], keys));
+    MEASURE("encrypt", "reference", 8, 1, 1, des_encrypt_reference(x, keys, &x));
+    MEASURE("decrypt", "reference", 8, 1, 1, des_decrypt_reference(x, keys, &x));
+    MEASURE("encrypt", "table", 8, 1, 1, des_encrypt_block(x, keys, &x));
+    MEASURE("decrypt", "table", 8, 1, 1, des_decrypt_block(x, keys, &x));
+    sink = x;
+}
+
+void bench_engines(void) {
+    static uint64_t blocks[512];
+    des_ctx ctx;
+    uint64_t des_keys[3] = {0x133457799BBCDFF1, 0x0E329232EA6D0D73, 0xA1B2C3D4E5F60718};
+
+    for (unsigned int i = 0; i < 512; i++)
+        blocks[i] = 0x0123456789ABCDEF ^ (i * 0x9E3779B97F4A7C15);
+
+    // One call of each engine at its native width, DES and 3DES
+    for (unsigned int key_count = 1; key_count <= 3; key_count += 2) {
+        des_init(&ctx, des_keys, key_count, DES_MODE_ECB, 0);
+        LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+            if (des_set_engine(&ctx, engine_names[e]) != 0)
+                continue;
+            const engine *engine = ctx.engine;
+            MEASURE(key_count == 1 ? "encrypt" : "encrypt_3des", engine->name, engine->blocks * 8, 1, engine->blocks,
+                    engine->crypt(blocks, ctx.keys, ctx.rounds, 0, blocks));
+            MEASURE(key_count == 1 ? "decrypt" : "decrypt_3des", engine->name, engine->blocks * 8, 1, engine->blocks,
+                    engine->crypt(blocks, ctx.keys, ctx.rounds, 1, blocks));
+        }
+    }
+}
+
+void bench_key_agile(void) {
+    enum { KEY_AGILE_BLOCKS = 4096 };
+    static uint64_t des_keys[KEY_AGILE_BLOCKS], few_keys[KEY_AGILE_BLOCKS], blocks[KEY_AGILE_BLOCKS];
+    uint64_t keys[16];
+
+    // A new key for every block, and the same stream drawn from only 8 keys
+    uint64_t state = 0x0123456789ABCDEF;
+    for (unsigned int i = 0; i < KEY_AGILE_BLOCKS; i++) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        des_keys[i] = state;
+        blocks[i] = state >> 17 ^ state << 23;
+    }
+    for (unsigned int i = 0; i < KEY_AGILE_BLOCKS; i++)
+        few_keys[i] = des_keys[i % 8];
+
+    schedule_cache cache;
+    memset(&cache, 0, sizeof(cache));
+    MEASURE("key_agile_generate_encrypt", "table", 8, 1, KEY_AGILE_BLOCKS,
+            for (unsigned int i = 0; i < KEY_AGILE_BLOCKS; i++) {
+                des_generate_keys(des_keys[i], keys);
+                des_encrypt_block(blocks[i], keys, &blocks[i]);
+            });
+    MEASURE("key_agile_distinct_keys", "cached", 8, 1, KEY_AGILE_BLOCKS,
+            des_crypt_key_blocks(des_keys, blocks, 0, blocks, KEY_AGILE_BLOCKS, &cache));
+    MEASURE("key_agile_8_keys", "cached", 8, 1, KEY_AGILE_BLOCKS,
+            des_crypt_key_blocks(few_keys, blocks, 0, blocks, KEY_AGILE_BLOCKS, &cache));
+}
+
+void bench_streams(void) {
+    enum { STREAMS = 512, STREAM_BLOCKS = 256 };
+    static uint8_t buffer[STREAMS * STREAM_BLOCKS * 8];
+    static uint64_t stream_keys[STREAMS][3];
+    static des_stream streams[STREAMS];
+    uint64_t des_keys[3] = {0x133457799BBCDFF1, 0x0E329232EA6D0D73, 0xA1B2C3D4E5F60718};
+    des_ctx ctx;
+
+    uint64_t state = 0x0123456789ABCDEF;
+    for (unsigned int s = 0; s < STREAMS; s++) {
+        LOOP(k, 3) {
+            state = state * 6364136223846793005 + 1442695040888963407;
+            stream_keys[s][k] = state;
+        }
+        streams[s] = (des_stream){.input = &buffer[s * STREAM_BLOCKS * 8], .output = &buffer[s * STREAM_BLOCKS * 8],
+                                  .nbytes = STREAM_BLOCKS * 8, .iv = state >> 17};
+    }
+    memset(buffer, 0x5A, sizeof(buffer));
+
+    // 512 CBC messages of 2 KiB: one after the other through des_encrypt_buffer, then in lockstep through every
+    // engine with the keys of the context and with keys of their own. bytes is all streams together.
+    for (unsigned int key_count = 1; key_count <= 3; key_count += 2) {
+        des_init(&ctx, des_keys, key_count, DES_MODE_CBC, 0);
+        MEASURE(key_count == 1 ? "cbc_streams_sequential" : "cbc_streams_sequential_3des", ctx.engine->name,
+                sizeof(buffer), 1, STREAMS * STREAM_BLOCKS,
+                for (unsigned int s = 0; s < STREAMS; s++) {
+                    des_set_iv(&ctx, streams[s].iv);
+                    des_encrypt_buffer(&ctx, streams[s].input, streams[s].output, streams[s].nbytes);
+                });
+
+        LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+            if (des_set_engine(&ctx, engine_names[e]) != 0)
+                continue;
+            for (unsigned int s = 0; s < STREAMS; s++)
+                streams[s].des_keys = NULL;
+            MEASURE(key_count == 1 ? "cbc_streams_lockstep" : "cbc_streams_lockstep_3des", ctx.engine->name,
+                    sizeof(buffer), 1, STREAMS * STREAM_BLOCKS, des_encrypt_streams(&ctx, streams, STREAMS));
+
+            for (unsigned int s = 0; s < STREAMS; s++) {
+                streams[s].des_keys = stream_keys[s];
+                streams[s].key_count = key_count;
+            }
+            MEASURE(key_count == 1 ? "cbc_streams_own_keys" : "cbc_streams_own_keys_3des", ctx.engine->name,
+                    sizeof(buffer), 1, STREAMS * STREAM_BLOCKS, des_encrypt_streams(&ctx, streams, STREAMS));
+        }
+    }
+}
+
+void bench_hex(void) {
+    enum { HEX_BLOCKS = 4096, LINE_LENGTH = 60 };
+    static uint64_t blocks[HEX_BLOCKS];
+    static char text[HEX_BLOCKS * 16], wrapped[HEX_BLOCKS * 16 + HEX_BLOCKS * 16 / LINE_LENGTH + 1];
+
+    for (unsigned int i = 0; i < HEX_BLOCKS; i++)
+        blocks[i] = 0x0123456789ABCDEF ^ (i * 0x9E3779B97F4A7C15);
+    des_encode_hex_scalar(blocks, HEX_BLOCKS, text);
+
+    // The same text with a line break every 60 characters, like `xxd -p`
+    size_t wrapped_length = 0;
+    for (size_t i = 0; i < sizeof(text); i++) {
+        wrapped[wrapped_length++] = text[i];
+        if (i % LINE_LENGTH == LINE_LENGTH - 1)
+            wrapped[wrapped_length++] = '\n';
+    }
+
+    // Rows are per block of ciphertext (16 characters), bytes is the text length
+    LOOP(c, sizeof(hex_codec_names) / sizeof(hex_codec_names[0])) {
+        const hex_codec *codec = des_find_hex_codec(hex_codec_names[c]);
+        if (codec == NULL)
+            continue;
+        hex_parser parser = {0, 0};
+        MEASURE("encode_hex", codec->name, sizeof(text), 1, HEX_BLOCKS, codec->encode(blocks, HEX_BLOCKS, text));
+        MEASURE("parse_hex", codec->name, sizeof(text), 1, HEX_BLOCKS,
+                sink += codec->parse(text, sizeof(text), &parser, blocks));
+        MEASURE("parse_hex_wrapped", codec->name, wrapped_length, 1, HEX_BLOCKS,
+                sink += codec->parse(wrapped, wrapped_length, &parser, blocks));
+    }
+
+    // The wrapped text 64 times over (4 MiB) through des_parse_hex_parallel at 1 to --threads threads
+    enum { COPIES = 64 };
+    char *large = malloc(wrapped_length * COPIES);
+    uint64_t *large_blocks = malloc(HEX_BLOCKS * COPIES * sizeof(uint64_t));
+    if (large == NULL || large_blocks == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(large);
+        free(large_blocks);
+        return;
+    }
+    for (unsigned int i = 0; i < COPIES; i++)
+        memcpy(&large[i * wrapped_length], wrapped, wrapped_length);
+    for (unsigned int threads = 1; threads <= options.threads; threads = next_thread_count(threads)) {
+        des_set_threads(threads);
+        hex_parser parser = {0, 0};
+        MEASURE("parse_hex_parallel", des_selected_hex_codec->name, wrapped_length * COPIES, threads,
+                HEX_BLOCKS * COPIES,
+                sink += des_parse_hex_parallel(large, wrapped_length * COPIES, &parser, large_blocks));
+    }
+    des_set_threads(1);
+    free(large);
+    free(large_blocks);
+}
+
+void bench_buffers(void) {
+    uint8_t *buffer = malloc(options.max_size);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return;
+    }
+    memset(buffer, 0x5A, options.max_size);
+
+    des_ctx ctx;
+    uint64_t key = 0x133457799BBCDFF1;
+    des_init(&ctx, &key, 1, DES_MODE_ECB, 0);
+
+    // Every engine on 1 MiB, then the selected engine over all sizes and thread counts
+    uint64_t engine_size = options.max_size < (1 << 20) ? options.max_size & ~(uint64_t)7 : 1 << 20;
+    LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+        if (des_set_engine(&ctx, engine_names[e]) != 0)
+            continue;
+        MEASURE("encrypt_buffer", ctx.engine->name, engine_size, 1, engine_size / 8,
+                des_encrypt_buffer(&ctx, buffer, buffer, engine_size));
+    }
+
+    des_init(&ctx, &key, 1, DES_MODE_ECB, 0);
+    for (unsigned int threads = 1; threads <= options.threads; threads = next_thread_count(threads)) {
+        des_set_threads(threads);
+        for (uint64_t size = 8; size <= options.max_size; size = next_size(size)) {
+            MEASURE("encrypt_buffer", ctx.engine->name, size, threads, size / 8,
+                    des_encrypt_buffer(&ctx, buffer, buffer, size));
+        }
+    }
+    des_set_threads(1);
+    free(buffer);
+}
+
+int bench_files(void) {
+    char plain_name[] = "/tmp/des_bench_XXXXXX", cipher_name[] = "/tmp/des_bench_XXXXXX";
+    int plain = mkstemp(plain_name), cipher = mkstemp(cipher_name);
+    if (plain < 0 || cipher < 0) {
+        perror("Error creating benchmark files");
+        return 1;
+    }
+    close(cipher);
+
+    // Write max_size bytes of plaintext once
+    static uint8_t chunk[1 << 16];
+    memset(chunk, 0xA5, sizeof(chunk));
+    for (uint64_t written = 0; written < options.max_size;) {
+        size_t length = options.max_size - written < sizeof(chunk) ? options.max_size - written : sizeof(chunk);
+        if (write(plain, chunk, length) != (ssize_t)length) {
+            perror("Error writing benchmark file");
+            close(plain);
+            unlink(plain_name);
+            unlink(cipher_name);
+            return 1;
+        }
+        written += length;
+    }
+    close(plain);
+
+    des_ctx ctx;
+    uint64_t key = 0x133457799BBCDFF1;
+    des_init(&ctx, &key, 1, DES_MODE_ECB, 0);
+    char output_name[] = "/tmp/des_bench_XXXXXX";
+    int output = mkstemp(output_name);
+    close(output);
+
+    // The file functions print nothing on success, whole-file rows count the padding block too. Streams run
+    // one chunk after the other (depth 0) and as a pipeline through io_uring and through I/O threads.
+    static const struct {
+        const char *suffix;
+        unsigned int depth;
+        const char *io;
+        unsigned int flags;
+    } variants[] = {
+            {"", 0, NULL, 0},
+            {"_uring", PIPELINE_DEPTH, "uring", 0},
+            {"_io_threads", PIPELINE_DEPTH, "threads", 0},
+            {"_mmap", 0, NULL, DES_MMAP},
+    };
+    int status = 0;
+    uint64_t blocks = options.max_size / 8 + 1;
+    for (unsigned int threads = 1; threads <= options.threads && status == 0; threads = next_thread_count(threads)) {
+        des_set_threads(threads);
+        LOOP(v, sizeof(variants) / sizeof(variants[0])) {
+            bench_timer timer;
+            double ns, cycles;
+            char stage[64];
+            des_set_pipeline(variants[v].depth, 0);
+            if (variants[v].io != NULL)
+                setenv("DES_IO", variants[v].io, 1);
+
+            start_timer(&timer);
+            status |= des_encrypt_file(&ctx, plain_name, cipher_name, variants[v].flags);
+            stop_timer(&timer, &ns, &cycles);
+            snprintf(stage, sizeof(stage), "encrypt_file%s", variants[v].suffix);
+            report(stage, ctx.engine->name, options.max_size, threads, blocks, ns, cycles);
+
+            start_timer(&timer);
+            status |= des_decrypt_file(&ctx, cipher_name, output_name, variants[v].flags);
+            stop_timer(&timer, &ns, &cycles);
+            snprintf(stage, sizeof(stage), "decrypt_file%s", variants[v].suffix);
+            report(stage, ctx.engine->name, options.max_size, threads, blocks, ns, cycles);
+        }
+    }
+    des_set_pipeline(PIPELINE_DEPTH, 0);
+    unsetenv("DES_IO");
+    des_set_threads(1);
+
+    unlink(plain_name);
+    unlink(cipher_name);
+    unlink(output_name);
+    return status;
+}
@@ -0,0 +1,220 @@
+// ##################################################################################################################
+// Bitsliced DES Engine
+// ##################################################################################################################
+/*
+ * This file is included by des.c once per word width, it has no include guard on purpose.
+ * The includer defines:
+ *
+ *      BITSLICE_WORD       type of one bit-plane (uint64_t or a GCC vector of uint64_t)
+ *      BITSLICE_LANES      number of uint64_t in a BITSLICE_WORD, every lane carries 64 blocks
+ *      BITSLICE_NAME(x)    adds the width suffix to the function names
+ *      BITSLICE_TARGET     function attributes for the instruction set of this width
+ *
+ * and gets BITSLICE_NAME(bitslice_crypt), which encrypts or decrypts 64 * BITSLICE_LANES blocks per call
+ * with 16 (DES) or 48 (3DES) rounds, BITSLICE_NAME(bitslice_crypt_lanes), the same with keys of their own for
+ * every block, and BITSLICE_NAME(bitslice_search), which tries 64 * BITSLICE_LANES keys on one known
+ * plaintext/ciphertext pair.
+ */
+
+BITSLICE_TARGET FORCE_INLINE void BITSLICE_NAME(bitslice_s_box)(unsigned char box, const BITSLICE_WORD input[6],
+                                                                BITSLICE_WORD output[4]) {
+    const BITSLICE_WORD zero = {0};
+
+    // All 16 Boolean functions of the bottom two input bits (b5 b6)
+    BITSLICE_WORD b5 = input[4], b6 = input[5];
+    BITSLICE_WORD functions[16] = {zero, ~b5 & ~b6, ~b5 & b6, ~b5,
+                                   b5 & ~b6, ~b6, b5 ^ b6, ~(b5 & b6),
+                                   b5 & b6, ~(b5 ^ b6), b6, ~b5 | b6,
+                                   b5, b5 | ~b6, b5 | b6, ~zero};
+
+    // Decode the top four input bits (b1 b2 b3 b4) into their 16 minterms
+    BITSLICE_WORD high[4] = {~input[0] & ~input[1], ~input[0] & input[1], input[0] & ~input[1], input[0] & input[1]};
+    BITSLICE_WORD low[4] = {~input[2] & ~input[3], ~input[2] & input[3], input[2] & ~input[3], input[2] & input[3]};
+    BITSLICE_WORD minterms[16];
+    LOOP(p, 16) {
+        minterms[p] = high[p >> 2] & low[p & 3];
+    }
+
+    // Each output bit is the sum of minterm & leaf function, the leaves are constants so this unrolls into a gate network
+    LOOP(q, 4) {
+        BITSLICE_WORD result = zero;
+        LOOP(p, 16) {
+            result |= minterms[p] & functions[bitslice_s_box_leaves[box][q][p]];
+        }
+        output[q] = result;
+    }
+}
+
+BITSLICE_TARGET FORCE_INLINE void BITSLICE_NAME(bitslice_rounds)(const uint64_t *input, const uint64_t *keys,
+                                                                 const BITSLICE_WORD (*key_planes)[56],
+                                                                 unsigned char rounds, char decrypting,
+                                                                 uint64_t *output) {
+    // keys is the schedule shared by all blocks, unless there are key_planes: the key index bits of every block
+    // per DES pass (see bitslice_crypt_lanes). Inlined with one of them constant, so each caller gets its own loop.
+    // lanes[i][g] holds bit i (counted from the top) of the 64 blocks of group g
+    uint64_t lanes[64][BITSLICE_LANES];
+    uint64_t group[64];
+
+    LOOP(g, BITSLICE_LANES) {
+        LOOP(i, 64) {
+            group[i] = input[g * 64 + i];
+        }
+        transpose_64x64(group);
+        LOOP(i, 64) {
+            lanes[i][g] = group[i];
+        }
+    }
+
+    // The initial permutation is just a renaming of the planes
+    BITSLICE_WORD halves[64];
+    LOOP(i, 64) {
+        memcpy(&halves[i], lanes[initial_permutation_table[i] - 1], sizeof(BITSLICE_WORD));
+    }
+    BITSLICE_WORD *l = halves;
+    BITSLICE_WORD *r = halves + 32;
+
+    LOOP(round, rounds) {
+        unsigned char step = decrypting ? rounds - 1 - round : round;
+        uint64_t key = keys != NULL ? keys[step] : 0;
+
+        // The middle pass of EDE decrypts with K2, so it runs the K2 schedule backwards
+        const BITSLICE_WORD *planes = key_planes != NULL ? key_planes[step / 16] : NULL;
+        const unsigned char *renaming = round_key_planes[step / 16 == 1 ? 15 - step % 16 : step % 16];
+
+#pragma GCC unroll 8
+        LOOP(box, 8) {
+            // Expansion is a renaming too, a key bit of 1 inverts the whole plane
+            BITSLICE_WORD s_box_input[6], s_box_output[4];
+            LOOP(t, 6) {
+                uint64_t key_bit = (key >> (47 - (box * 6 + t))) & 1;
+                BITSLICE_WORD plane = r[expansion_d_box_table[box * 6 + t] - 1];
+                s_box_input[t] = planes != NULL ? plane ^ planes[renaming[box * 6 + t]] : plane ^ (0 - key_bit);
+            }
+            BITSLICE_NAME(bitslice_s_box)(box, s_box_input, s_box_output);
+
+            // Straight permutation as a renaming, xored straight into the left half
+            LOOP(q, 4) {
+                l[straight_permutation_inverse[box * 4 + q]] ^= s_box_output[q];
+            }
+        }
+
+        // Between the DES passes of 3DES the FP/IP pair cancels out and only undoes this swap
+        if (round % 16 != 15 || round + 1 == rounds) {
+            BITSLICE_WORD *temp = l;
+            l = r;
+            r = temp;
+        }
+    }
+
+    // Undo the last swap (R16 L16), then apply the final permutation as a renaming
+    LOOP(i, 64) {
+        unsigned char bit = Final_permutation[i] - 1;
+        memcpy(lanes[i], bit < 32 ? &r[bit] : &l[bit - 32], sizeof(BITSLICE_WORD));
+    }
+
+    LOOP(g, BITSLICE_LANES) {
+        LOOP(i, 64) {
+            group[i] = lanes[i][g];
+        }
+        transpose_64x64(group);
+        LOOP(i, 64) {
+            output[g * 64 + i] = group[i];
+        }
+    }
+}
+
+BITSLICE_TARGET static void BITSLICE_NAME(bitslice_crypt)(const uint64_t *input, const uint64_t *keys,
+                                                          unsigned char rounds, char decrypting, uint64_t *output) {
+    BITSLICE_NAME(bitslice_rounds)(input, keys, NULL, rounds, decrypting, output);
+}
+
+BITSLICE_TARGET static void BITSLICE_NAME(bitslice_crypt_lanes)(const uint64_t *input, const uint64_t *key_indices,
+                                                                unsigned char rounds, char decrypting,
+                                                                uint64_t *output) {
+    // Key p of block i is the key index key_indices[i * rounds / 16 + p]. Transposed like the blocks, the 56 bits
+    // of the keys become planes and the key schedule is a renaming of them, as in the key search.
+    unsigned char passes = rounds / 16;
+    BITSLICE_WORD key_planes[3][56];
+    uint64_t lanes[64][BITSLICE_LANES];
+    uint64_t group[64];
+
+    LOOP(p, passes) {
+        LOOP(g, BITSLICE_LANES) {
+            LOOP(i, 64) {
+                group[i] = key_indices[(g * 64 + i) * passes + p];
+            }
+            transpose_64x64(group);
+            LOOP(i, 64) {
+                lanes[i][g] = group[i];
+            }
+        }
+        // Index bit b (from the bottom) is plane 63 - b
+        LOOP(b, 56) {
+            memcpy(&key_planes[p][b], lanes[63 - b], sizeof(BITSLICE_WORD));
+        }
+    }
+
+    BITSLICE_NAME(bitslice_rounds)(input, NULL, (const BITSLICE_WORD (*)[56])key_planes, rounds, decrypting, output);
+}
+
+BITSLICE_TARGET static void BITSLICE_NAME(bitslice_search)(uint64_t plain_text, uint64_t cipher_text, uint64_t base,
+                                                           uint64_t *matches) {
+    // Block j of lane g is encrypted with the key of index base + g * 64 + j (base is a multiple of the width).
+    // The 56 key bits are planes too, so the key schedule is a renaming of them (round_key_planes): the six bottom
+    // bits count through each uint64_t, the lanes differ in the next ones and the rest is the same everywhere.
+    const uint64_t counting[6] = {0xAAAAAAAAAAAAAAAA, 0xCCCCCCCCCCCCCCCC, 0xF0F0F0F0F0F0F0F0,
+                                  0xFF00FF00FF00FF00, 0xFFFF0000FFFF0000, 0xFFFFFFFF00000000};
+    BITSLICE_WORD key_planes[56];
+    uint64_t group[BITSLICE_LANES];
+    LOOP(b, 56) {
+        LOOP(g, BITSLICE_LANES) {
+            group[g] = b < 6 ? counting[b] : 0 - (((base + g * 64) >> b) & 1);
+        }
+        memcpy(&key_planes[b], group, sizeof(BITSLICE_WORD));
+    }
+
+    // Every block is the same plaintext, so after the initial permutation each plane is all zeros or all ones
+    uint64_t permuted;
+    des_initial_permutation_fast(plain_text, &permuted);
+    BITSLICE_WORD halves[64];
+    LOOP(i, 64) {
+        LOOP(g, BITSLICE_LANES) {
+            group[g] = 0 - ((permuted >> (63 - i)) & 1);
+        }
+        memcpy(&halves[i], group, sizeof(BITSLICE_WORD));
+    }
+    BITSLICE_WORD *l = halves;
+    BITSLICE_WORD *r = halves + 32;
+
+    LOOP(round, 16) {
+#pragma GCC unroll 8
+        LOOP(box, 8) {
+            BITSLICE_WORD s_box_input[6], s_box_output[4];
+            LOOP(t, 6) {
+                s_box_input[t] = r[expansion_d_box_table[box * 6 + t] - 1] ^
+                                 key_planes[round_key_planes[round][box * 6 + t]];
+            }
+            BITSLICE_NAME(bitslice_s_box)(box, s_box_input, s_box_output);
+            LOOP(q, 4) {
+                l[straight_permutation_inverse[box * 4 + q]] ^= s_box_output[q];
+            }
+        }
+        BITSLICE_WORD *temp = l;
+        l = r;
+        r = temp;
+    }
+
+    // The ciphertext before the final permutation is R16 L16, which is the initial permutation of the ciphertext
+    des_initial_permutation_fast(cipher_text, &permuted);
+    BITSLICE_WORD mismatch = {0};
+    LOOP(i, 64) {
+        LOOP(g, BITSLICE_LANES) {
+            group[g] = 0 - ((permuted >> (63 - i)) & 1);
+        }
+        BITSLICE_WORD expected;
+        memcpy(&expected, group, sizeof(BITSLICE_WORD));
+        mismatch |= (i < 32 ? r[i] : l[i - 32]) ^ expected;
+    }
+    mismatch = ~mismatch;
+    memcpy(matches, &mismatch, sizeof(BITSLICE_WORD));
+}
@@ -0,0 +1,572 @@
+// ##################################################################################################################
+/*
+ * desd: keeps the key schedules of a key file resident and serves encrypt/decrypt requests over a Unix socket.
+ * The frame layout is documented next to daemon_request in des_internal.h.
+ *
+ * Every worker thread runs an event loop of its own (epoll), takes new connections from the shared listening
+ * socket and serves them. All the requests one epoll_wait returns are handled as a batch: the blocks of all
+ * requests with the same key and direction go through the block engine in a single call.
+ *
+ *      desd [-j threads] <socket> <key file>
+ *
+ * The key file has one key per line: the key ID, then one (DES) or two or three (3DES) keys of 16 hex digits.
+ */
+
+#define _GNU_SOURCE     // accept4
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "des_internal.h"
+
+#define MAX_EVENTS 64
+
+
+// ##################################################################################################################
+// Function Prototypes
+// ##################################################################################################################
+
+// keys, sorted by ID
+typedef struct {
+    uint32_t id;
+    des_ctx cipher;
+} daemon_key;
+
+int compare_keys(const void *a, const void *b);
+
+int read_key_file(const char *filename, daemon_key **keys, size_t *key_count);
+
+const daemon_key *find_key(uint32_t id);
+
+// connections
+typedef struct {
+    int fd;
+    uint8_t *input;             // received bytes, the frames not handled yet
+    size_t input_length, input_capacity;
+    size_t input_used;          // bytes of complete frames in this round's batch
+    uint8_t *output;            // responses not sent yet
+    size_t output_length, output_capacity, output_sent;
+    char closing;               // close once the output is sent
+    char writing;               // waiting for EPOLLOUT
+} connection;
+
+int reserve(uint8_t **buffer, size_t *capacity, size_t length);
+
+void receive(connection *conn);
+
+void flush(int epoll, connection *conn);
+
+void close_connection(int epoll, connection *conn);
+
+// event loops and batching
+typedef struct {
+    connection *conn;
+    daemon_request header;
+    const uint8_t *payload;
+    const daemon_key *key;
+    daemon_status status;
+    size_t offset;              // of its blocks in the batch buffers
+    char assigned;
+} pending_request;
+
+typedef struct {
+    pthread_t thread;
+    int epoll;
+    pending_request *pending;
+    size_t pending_count, pending_capacity;
+    connection **touched;
+    size_t touched_count, touched_capacity;
+    uint64_t *batch_input, *batch_output;
+    size_t batch_capacity;
+    uint64_t requests, blocks, engine_calls;
+} event_loop;
+
+void *run_event_loop(void *arg);
+
+void accept_connections(event_loop *loop);
+
+int parse_requests(event_loop *loop, connection *conn);
+
+void process_batch(event_loop *loop);
+
+void respond(const pending_request *request, const uint64_t *blocks);
+
+// ##################################################################################################################
+
+daemon_key *keys;
+size_t key_count;
+int listener;
+_Atomic char stopping;
+
+
+// ##################################################################################################################
+// Main Function
+// ##################################################################################################################
+
+int main(int argc, char **argv) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int threads = cores > 0 ? cores : 1;
+    int option;
+    while ((option = getopt(argc, argv, "j:")) != -1) {
+        if (option != 'j' || (threads = strtoul(optarg, NULL, 10)) < 1 || threads > 1024) {
+            argc = 0;
+            break;
+        }
+    }
+    if (argc - optind != 2) {
+        printf("Usage: %s [-j threads] <socket> <key file>\n", argv[0]);
+        printf("The key file has one key per line: its ID, then one to three keys of 16 hex digits each\n");
+        return 1;
+    }
+    const char *socket_path = argv[optind];
+    if (read_key_file(argv[optind + 1], &keys, &key_count) != 0)
+        return 1;
+
+    // Only the owner may talk to the socket, a stale socket from an earlier run is replaced
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Error: socket path too long\n");
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+    struct stat info;
+    if (stat(socket_path, &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(socket_path);
+    umask(0077);
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        perror(socket_path);
+        return 1;
+    }
+
+    // SIGINT and SIGTERM stop the daemon, the loops check for that between rounds
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    event_loop *loops = calloc(threads, sizeof(event_loop));
+    unsigned int started = 0;
+    for (; loops != NULL && started < threads; started++) {
+        if (pthread_create(&loops[started].thread, NULL, run_event_loop, &loops[started]) != 0) {
+            perror("Error starting event loop");
+            break;
+        }
+    }
+    printf("desd: serving %zu keys on %s with %u threads\n", key_count, socket_path, started);
+    fflush(stdout);
+
+    int signal_number;
+    if (started == threads)
+        sigwait(&signals, &signal_number);
+    atomic_store(&stopping, 1);
+
+    uint64_t requests = 0, blocks = 0, engine_calls = 0;
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(loops[i].thread, NULL);
+        requests += loops[i].requests;
+        blocks += loops[i].blocks;
+        engine_calls += loops[i].engine_calls;
+    }
+    printf("desd: served %" PRIu64 " requests, %" PRIu64 " blocks in %" PRIu64 " engine calls\n", requests, blocks,
+           engine_calls);
+
+    close(listener);
+    unlink(socket_path);
+    free(loops);
+    free(keys);
+    return started == threads ? 0 : 1;
+}
+
+// ##################################################################################################################
+
+
+// ##################################################################################################################
+// Function Definitions
+// ##################################################################################################################
+
+
+int compare_keys(const void *a, const void *b) {
+    uint32_t x = ((const daemon_key *)a)->id, y = ((const daemon_key *)b)->id;
+    return (x > y) - (x < y);
+}
+
+int read_key_file(const char *filename, daemon_key **keys, size_t *key_count) {
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        perror(filename);
+        return 1;
+    }
+
+    *keys = NULL;
+    *key_count = 0;
+    char *line = NULL;
+    size_t capacity = 0, line_number = 0;
+    int status = 0;
+    while (status == 0 && getline(&line, &capacity, fp) != -1) {
+        line_number++;
+        char *text = line + strspn(line, " \t\r\n");
+        if (*text == '\0' || *text == '#')
+            continue;
+
+        // ID, then the keys: the hex parser skips the spaces between them
+        char *end;
+        unsigned long id = strtoul(text, &end, 0);
+        uint64_t des_keys[4];
+        hex_parser parser = {0, 0};
+        size_t count = end != text && id <= UINT32_MAX ? des_parse_hex(end, strlen(end), &parser, des_keys) : 0;
+        daemon_key *grown = realloc(*keys, (*key_count + 1) * sizeof(daemon_key));
+        if (count < 1 || count > 3 || parser.digits != 0 || grown == NULL) {
+            printf("Error: %s line %zu: expected a key ID and one to three keys of 16 hex digits\n", filename,
+                   line_number);
+            free(grown != NULL ? grown : *keys);
+            status = 1;
+            break;
+        }
+        *keys = grown;
+        (*keys)[*key_count].id = id;
+        des_init(&(*keys)[*key_count].cipher, des_keys, count, DES_MODE_ECB, 0);
+        (*key_count)++;
+    }
+    free(line);
+    fclose(fp);
+    if (status != 0)
+        return 1;
+
+    qsort(*keys, *key_count, sizeof(daemon_key), compare_keys);
+    for (size_t i = 1; i < *key_count; i++) {
+        if ((*keys)[i].id == (*keys)[i - 1].id) {
+            printf("Error: %s: key ID %" PRIu32 " appears twice\n", filename, (*keys)[i].id);
+            free(*keys);
+            return 1;
+        }
+    }
+    if (*key_count == 0) {
+        printf("Error: %s holds no keys\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+const daemon_key *find_key(uint32_t id) {
+    size_t low = 0, high = key_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (keys[middle].id == id)
+            return &keys[middle];
+        if (keys[middle].id < id)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return NULL;
+}
+
+int reserve(uint8_t **buffer, size_t *capacity, size_t length) {
+    if (length <= *capacity)
+        return 0;
+    size_t grown_capacity = *capacity < 4096 ? 4096 : *capacity;
+    while (grown_capacity < length)
+        grown_capacity *= 2;
+    uint8_t *grown = realloc(*buffer, grown_capacity);
+    if (grown == NULL)
+        return 1;
+    *buffer = grown;
+    *capacity = grown_capacity;
+    return 0;
+}
+
+void receive(connection *conn) {
+    // Everything the socket has now, the frames are cut out of it afterwards
+    for (;;) {
+        if (reserve(&conn->input, &conn->input_capacity, conn->input_length + 65536) != 0) {
+            conn->closing = 1;
+            return;
+        }
+        ssize_t count = read(conn->fd, &conn->input[conn->input_length], conn->input_capacity - conn->input_length);
+        if (count > 0) {
+            conn->input_length += count;
+            continue;
+        }
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            conn->closing = 1;
+        return;
+    }
+}
+
+void flush(int epoll, connection *conn) {
+    while (conn->output_sent < conn->output_length) {
+        ssize_t count = send(conn->fd, &conn->output[conn->output_sent], conn->output_length - conn->output_sent,
+                             MSG_NOSIGNAL);
+        if (count > 0) {
+            conn->output_sent += count;
+            continue;
+        }
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        conn->closing = 1;
+        conn->output_sent = conn->output_length;
+    }
+    if (conn->output_sent == conn->output_length)
+        conn->output_sent = conn->output_length = 0;
+
+    // Ask for EPOLLOUT only while there is something left to send
+    char writing = conn->output_length > 0;
+    if (writing != conn->writing) {
+        struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP | (writing ? EPOLLOUT : 0), .data.ptr = conn};
+        epoll_ctl(epoll, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->writing = writing;
+    }
+}
+
+void close_connection(int epoll, connection *conn) {
+    epoll_ctl(epoll, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->input);
+    free(conn->output);
+    free(conn);
+}
+
+void *run_event_loop(void *arg) {
+    event_loop *loop = arg;
+    loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    // EPOLLEXCLUSIVE wakes one loop per new connection, and the connection stays with that loop
+    struct epoll_event event = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+    if (loop->epoll < 0 || epoll_ctl(loop->epoll, EPOLL_CTL_ADD, listener, &event) != 0) {
+        perror("Error setting up the event loop");
+        atomic_store(&stopping, 1);
+        kill(getpid(), SIGTERM);
+        return NULL;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!atomic_load(&stopping)) {
+        int count = epoll_wait(loop->epoll, events, MAX_EVENTS, 200);
+        if (count < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        // Gather the complete frames of every ready connection into one batch
+        loop->pending_count = 0;
+        loop->touched_count = 0;
+        for (int i = 0; i < count; i++) {
+            connection *conn = events[i].data.ptr;
+            if (conn == NULL) {
+                accept_connections(loop);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                receive(conn);
+            if (loop->touched_count == loop->touched_capacity) {
+                size_t capacity = loop->touched_capacity == 0 ? MAX_EVENTS : 2 * loop->touched_capacity;
+                connection **grown = realloc(loop->touched, capacity * sizeof(connection *));
+                if (grown == NULL) {
+                    conn->closing = 1;
+                    continue;
+                }
+                loop->touched = grown;
+                loop->touched_capacity = capacity;
+            }
+            loop->touched[loop->touched_count++] = conn;
+            if (parse_requests(loop, conn) != 0)
+                conn->closing = 1;
+        }
+        process_batch(loop);
+
+        // Send what is ready, keep the unfinished frames, and drop closed connections once they are flushed
+        for (size_t i = 0; i < loop->touched_count; i++) {
+            connection *conn = loop->touched[i];
+            flush(loop->epoll, conn);
+            if (conn->closing && conn->output_length == 0)
+                close_connection(loop->epoll, conn);
+        }
+    }
+
+    free(loop->pending);
+    free(loop->touched);
+    free(loop->batch_input);
+    free(loop->batch_output);
+    close(loop->epoll);
+    return NULL;
+}
+
+void accept_connections(event_loop *loop) {
+    for (;;) {
+        int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        connection *conn = calloc(1, sizeof(connection));
+        struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = conn};
+        if (conn == NULL || epoll_ctl(loop->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+    }
+}
+
+int parse_requests(event_loop *loop, connection *conn) {
+    // The payloads stay in conn->input until process_batch is done with them
+    size_t used = 0;
+    while (conn->input_length - used >= DAEMON_REQUEST_HEADER) {
+        pending_request request = {.conn = conn};
+        des_decode_daemon_request(&conn->input[used], &request.header);
+        if (request.header.length > DAEMON_MAX_PAYLOAD) {
+            // The stream cannot be trusted past this frame
+            request.status = STATUS_TOO_LARGE;
+            request.header.length = 0;
+            used = conn->input_length;
+            conn->closing = 1;
+        } else if (conn->input_length - used - DAEMON_REQUEST_HEADER < request.header.length) {
+            break;
+        } else {
+            request.payload = &conn->input[used + DAEMON_REQUEST_HEADER];
+            request.key = find_key(request.header.key_id);
+            used += DAEMON_REQUEST_HEADER + request.header.length;
+            if (request.key == NULL)
+                request.status = STATUS_UNKNOWN_KEY;
+            else if ((request.header.op != OP_ENCRYPT && request.header.op != OP_DECRYPT) ||
+                     request.header.mode > DES_MODE_CTR || request.header.length % 8 != 0)
+                request.status = STATUS_BAD_REQUEST;
+        }
+
+        if (loop->pending_count == loop->pending_capacity) {
+            size_t capacity = loop->pending_capacity == 0 ? 256 : 2 * loop->pending_capacity;
+            pending_request *grown = realloc(loop->pending, capacity * sizeof(pending_request));
+            if (grown == NULL)
+                return 1;
+            loop->pending = grown;
+            loop->pending_capacity = capacity;
+        }
+        loop->pending[loop->pending_count++] = request;
+    }
+
+    conn->input_used = used;
+    return 0;
+}
+
+void process_batch(event_loop *loop) {
+    // Room for the blocks of every request in the batch
+    size_t total = 0;
+    for (size_t i = 0; i < loop->pending_count; i++)
+        total += loop->pending[i].header.length / 8;
+    if (total > loop->batch_capacity) {
+        free(loop->batch_input);
+        free(loop->batch_output);
+        loop->batch_input = malloc(total * sizeof(uint64_t));
+        loop->batch_output = malloc(total * sizeof(uint64_t));
+        loop->batch_capacity = loop->batch_input != NULL && loop->batch_output != NULL ? total : 0;
+        for (size_t i = 0; i < loop->pending_count && loop->batch_capacity == 0; i++) {
+            if (loop->pending[i].status == STATUS_OK)
+                loop->pending[i].status = STATUS_TOO_LARGE;
+        }
+    }
+
+    // Requests with the same key and engine direction share one engine call over consecutive blocks. CBC
+    // encryption chains every block into the next one, so each of those is a call of its own.
+    size_t cursor = 0;
+    for (size_t i = 0; i < loop->pending_count; i++) {
+        pending_request *first = &loop->pending[i];
+        if (first->assigned || first->status != STATUS_OK)
+            continue;
+        const daemon_key *key = first->key;
+        char chained = first->header.mode == DES_MODE_CBC && first->header.op == OP_ENCRYPT;
+        char decrypting = first->header.op == OP_DECRYPT && first->header.mode != DES_MODE_CTR;
+        size_t start = cursor;
+
+        for (size_t j = i; j < (chained ? i + 1 : loop->pending_count); j++) {
+            pending_request *request = &loop->pending[j];
+            char request_decrypting = request->header.op == OP_DECRYPT && request->header.mode != DES_MODE_CTR;
+            if (request->assigned || request->status != STATUS_OK || request->key != key ||
+                request_decrypting != decrypting || (!chained && request->header.mode == DES_MODE_CBC && !decrypting))
+                continue;
+            request->assigned = 1;
+            request->offset = cursor;
+
+            // CTR runs the engine over the counters, the other modes over the data
+            size_t blocks = request->header.length / 8;
+            for (size_t k = 0; k < blocks; k++) {
+                loop->batch_input[cursor + k] = request->header.mode == DES_MODE_CTR ? request->header.iv + k
+                                                                                  : des_load_block(&request->payload[k * 8]);
+            }
+            cursor += blocks;
+        }
+
+        if (chained) {
+            uint64_t chain = first->header.iv;
+            for (size_t k = start; k < cursor; k++) {
+                des_crypt_block(loop->batch_input[k] ^ chain, key->cipher.keys, key->cipher.rounds, 0,
+                                &loop->batch_output[k]);
+                chain = loop->batch_output[k];
+            }
+        } else {
+            des_crypt_blocks(key->cipher.engine, &loop->batch_input[start], key->cipher.keys, key->cipher.rounds,
+                             decrypting, &loop->batch_output[start], cursor - start);
+        }
+        loop->engine_calls++;
+        loop->blocks += cursor - start;
+    }
+
+    // Finish the modes and answer in request order
+    for (size_t i = 0; i < loop->pending_count; i++) {
+        pending_request *request = &loop->pending[i];
+        uint64_t *blocks = &loop->batch_output[request->offset];
+        size_t count = request->status == STATUS_OK ? request->header.length / 8 : 0;
+        if (request->header.mode == DES_MODE_CTR) {
+            for (size_t k = 0; k < count; k++)
+                blocks[k] ^= des_load_block(&request->payload[k * 8]);
+        } else if (request->header.mode == DES_MODE_CBC && request->header.op == OP_DECRYPT) {
+            for (size_t k = 0; k < count; k++)
+                blocks[k] ^= k == 0 ? request->header.iv : loop->batch_input[request->offset + k - 1];
+        }
+        respond(request, blocks);
+        loop->requests++;
+    }
+
+    // The frames are answered, drop them from the input buffers
+    for (size_t i = 0; i < loop->touched_count; i++) {
+        connection *conn = loop->touched[i];
+        memmove(conn->input, &conn->input[conn->input_used], conn->input_length - conn->input_used);
+        conn->input_length -= conn->input_used;
+        conn->input_used = 0;
+    }
+}
+
+void respond(const pending_request *request, const uint64_t *blocks) {
+    connection *conn = request->conn;
+    daemon_response response = {.length = request->status == STATUS_OK ? request->header.length : 0,
+                                .status = request->status, .request_id = request->header.request_id};
+    if (reserve(&conn->output, &conn->output_capacity,
+                conn->output_length + DAEMON_RESPONSE_HEADER + response.length) != 0) {
+        conn->closing = 1;
+        return;
+    }
+
+    uint8_t *bytes = &conn->output[conn->output_length];
+    des_encode_daemon_response(&response, bytes);
+    for (size_t k = 0; k < response.length / 8; k++)
+        des_store_block(blocks[k], &bytes[DAEMON_RESPONSE_HEADER + k * 8]);
+    conn->output_length += DAEMON_RESPONSE_HEADER + response.length;
+}
@@ -0,0 +1,4320 @@
+// if you view from github, make index space 4 to view the code properly (https://github.com/zainmo11/Data-encryption-standard-DES-/blob/main/des.c?ts=4)
+// ##################################################################################################################
+/*                                            -------------------------------------
+ *                                            |     DES Encryption/Decryption     |
+ *  							              |              Team : 28            |
+ *  							              |   Abdelrhman Zain Mohamed 2101646 |
+ *  							              |   Abdelrhman Atef Saad    2101645 |
+ *  							              |  Mahmoud Hamdy Mohamed    2001300 |
+ *                                            |  Mohamed Adham Mohamed    2001184 |
+ *  							              |  Yassa Sfen Ayed Helmy    2001307 |
+ *  							              -------------------------------------
+ *
+ *
+ *      								                                      +--------------+
+ *  								                             	          |  64 bit Key  |
+ *  								                             	          +--------------+
+ *  								                             			         |
+ *  								                             	     +---------------------+
+ *  								                             	  ---|  Permuted Choice 1  |---  >>> 56 bit Key
+ *  								                             	  |  +---------------------+  |
+ *  								                             	  |                           |
+ *  								                             	  |                           |
+ *  								                             	  |                           |
+ *      		<--32 bit->	    <--32 bit->			           <--28 bit->		          <--28 bit->
+ *  			+----------+    +----------+                   +----------+               +----------+
+ *  			|  L(i-1)  |    |  R(i-1)  |                   |  C(i-1)  |               |  D(i-1)  |
+ *  			+----------+    +----------+                   +----------+               +----------+
+ *  			     |               |                              |                          |
+ *  			     |               |                              |                          |
+ *  			     |               |                              |                          |
+ *  			     |               |                              |                          |
+ *  			     |               |                              |                          |
+ *  	    -------------------------|                              |                          |
+ *        	|	     |        +------+-------+            +--------------------+      +--------------------+
+ *  		|	     |        | Expansion    |        ----|  Left Shift(s)     |      |    Left Shift(s)   |---
+ *  		|	     |        | Permutation  |        |   +--------------------+      +--------------------+  |
+ *  		|	     |        |    (E)       |        |                 |               |                     |
+ *  		|	     |        +------+-------+        |                 |               |                     |
+ *  		|	     |               |                |                 |               |                     |
+ *  		|	     |            48 bits             |                 |               |                     |
+ *  		|	     |               |                |                 |               |                     |
+ *  		|	     |          +-----+----+          |               +--------------------+                  |
+ *  		|	     |          |    XOR   |--------------------------|  Permuted Choice 2 |                  |
+ *  		|	     |          +-----+----+          |               +--------------------+                  |
+ *  		|	     |                |               |                                                       |
+ *  		|	     |             48 bits            |                                                       |
+ *  		|	     |                |               |                                                       |
+ *  		|	     |   +------------+------------+  |                                                       |
+ *  		|	     |   |  Substitution (S-box)   |  |                                                       |
+ *  		|	     |   +------------+------------+  |                                                       |
+ *  		|	     |                |               |                                                       |
+ *  		|	     |             32 bits            |                                                       |
+ *  		|	     |                |               |                                                       |
+ *  		|	     |         +------+-------+       |                                                       |
+ *  		|	     |         |  Permutation |       |                                                       |
+ *  		|	     |         |    (P)       |       |                                                       |
+ *  		|	     |         +------+-------+       |                                                       |
+ *  		|	     |                |               |                                                       |
+ *  		|	     |          +-----+----+          |                                                       |
+ *          |        |----------|    XOR   |          |                                                       |
+ *  		|	                +-----+----+          |                                                       |
+ *  		|	                     |                |                                                       |
+ *          |                        +                |                                                       |
+ *  		|	                     |                |                                                       |
+ *  	+----------+            +----------+     +-------------+                                      +-------------+
+ *  	|  L(i)    |            |   R(i)   |     |    C(i)     |                                      |    D(i)     |
+ *  	+----------+            +----------+     +-------------+                                      +-------------+
+ *
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "des_internal.h"
+
+// ##################################################################################################################
+// Internal Types and Function Prototypes
+// ##################################################################################################################
+
+#define SET_BIT(output, input, i, table, x, y) (*output) |= (((input) >> (x - table[i])) & 1) << (y - i)
+#define FORCE_INLINE static inline __attribute__((always_inline))
+#define ROTL32(x, n) ((uint32_t)(((x) << ((n) & 31)) | ((x) >> ((32 - (n)) & 31))))
+#define CHUNK_SIZE (1 << 20)   // bytes read from the input file per chunk and thread
+#define TASK_BLOCKS 4096        // blocks per thread pool task (32 KiB), small enough to stay in cache
+#define CONTAINER_VERSION 1
+#define CONTAINER_INDEX_ENTRY 16    // bytes per chunk index entry
+#define SEARCH_TASK_KEYS (1 << 18)  // keys per thread pool task of a key search
+#ifndef DES_STATS
+#define DES_STATS 1                 // phase counters for des_stats_print, 0 compiles them out of the library
+#endif
+
+// table initialization
+static void init_tables(void);
+
+static void init_library(void);
+
+// instrumentation: spans of rdtsc ticks (clock_gettime nanoseconds elsewhere) added to counters of the calling
+// thread, which only it adds to. They are atomic so des_stats_reset can zero them while the thread runs; relaxed
+// loads and stores are plain moves. With DES_STATS 0 the macros are empty and the hot paths carry nothing.
+typedef enum {
+    PHASE_SETUP,
+    PHASE_KEYS,
+    PHASE_READ,
+    PHASE_PARSE,
+    PHASE_CIPHER,
+    PHASE_ENCODE,
+    PHASE_WRITE,
+    PHASE_WAIT,
+    PHASE_COUNT
+} stats_phase;
+
+typedef struct thread_stats {
+    _Atomic uint64_t ticks[PHASE_COUNT];
+    _Atomic uint64_t calls[PHASE_COUNT];
+    _Atomic uint64_t bytes[PHASE_COUNT];
+    unsigned int index;         // in the order the threads first counted something
+    struct thread_stats *next;  // all of them, newest first
+} thread_stats;
+
+static _Thread_local thread_stats *stats_self;
+
+// at the end of a library thread: its counters go to the retired ones and its block is freed
+static void stats_retire(void);
+
+#if DES_STATS
+static thread_stats *stats_register(void);
+
+FORCE_INLINE uint64_t stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+#endif
+}
+
+FORCE_INLINE void stats_count(_Atomic uint64_t *counter, uint64_t amount) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+FORCE_INLINE void stats_add(stats_phase phase, uint64_t start, uint64_t bytes) {
+    thread_stats *stats = stats_self != NULL ? stats_self : stats_register();
+    stats_count(&stats->ticks[phase], stats_ticks() - start);
+    stats_count(&stats->calls[phase], 1);
+    stats_count(&stats->bytes[phase], bytes);
+}
+
+#define STATS_START(span) uint64_t span = stats_ticks()
+#define STATS_STOP(span, phase, bytes) stats_add(phase, span, bytes)
+#else
+#define STATS_START(span)
+#define STATS_STOP(span, phase, bytes)
+#endif
+
+// buffer and file front ends of the library API
+static int crypt_buffer(des_ctx *ctx, const uint8_t *input, uint8_t *output, size_t nbytes, char decrypting);
+
+static int crypt_file(des_ctx *ctx, const char *input_name, const char *output_name, unsigned int flags,
+                      char decrypting);
+
+// 1 if output_name names the regular file open as input, which opening the output would truncate before it is read
+static int same_file(int input, const char *output_name);
+
+static void encode_hex(const uint64_t *blocks, size_t size_in_blocks, char *text);
+
+static size_t count_hex_scalar(const char *text, size_t length);
+
+static int hex_codec_self_test(const hex_codec *codec);
+
+static void select_hex_codec(void);
+
+// parallel hex parsing: the text is cut into ranges of HEX_RANGE_SIZE that count their digits first, after a prefix
+// sum every range knows which block its first digit belongs to and they all parse at once
+typedef struct {
+    const char *text;
+    size_t length;
+    uint64_t *digits;           // per range: its digit count (at range + 1), then the digits before it
+    hex_parser carried;         // state from the previous call
+    hex_parser left;            // state for the next call, from the range with the incomplete last block
+    uint64_t *blocks;
+} hex_split_job;
+
+static void count_hex_task(void *context, uint64_t range);
+
+static void parse_hex_task(void *context, uint64_t range);
+
+static int padding_length(uint64_t block);
+
+static int encrypt_stream(FILE *input, FILE *output, des_ctx *cipher);
+
+// prefix: bytes already read from input, parsed before the rest
+static int decrypt_stream(FILE *input, FILE *output, des_ctx *cipher, const uint8_t *prefix, size_t prefix_length);
+
+// file chunking, set by des_set_pipeline
+typedef struct {
+    unsigned int depth;
+    size_t chunk_size;
+} pipeline_config;
+
+static size_t stream_chunk_size(void);
+
+// hex stream stages, shared by the stream functions and the pipeline: each call takes the next chunk of the
+// input (last: the one at the end of the file) and returns how many bytes it left in output
+typedef struct {
+    des_ctx *cipher;
+    uint64_t chain;
+    uint64_t *blocks;           // chunk_job results
+    uint64_t *cipher_text;      // decryption: the parsed ciphertext blocks
+    hex_parser parser;
+    uint64_t held;              // decryption: the newest plaintext block, held back in case it carries the padding
+    char holding;
+    char serial;                // already on a pool thread: the chunk jobs run on this thread alone
+} stream_stage;
+
+static int init_stream_stage(stream_stage *stage, des_ctx *cipher, size_t chunk_size, char decrypting);
+
+static void free_stream_stage(stream_stage *stage);
+
+// input has 8 bytes of room after length for the padding, output 2 * (length + 8) bytes
+static size_t encrypt_hex_stage(void *context, uint8_t *input, size_t length, char last, uint8_t *output);
+
+// output has length / 2 + 16 bytes
+static size_t decrypt_hex_stage(void *context, uint8_t *input, size_t length, char last, uint8_t *output);
+
+// asynchronous reads and writes at file offsets: io_uring, or one thread for the reads and one for the writes
+typedef struct {
+    int fd;
+    char writing;
+    uint8_t *buffer;
+    size_t length;
+    uint64_t offset;
+    unsigned int tag;           // handed back with the completion
+} io_request;
+
+typedef struct {
+    unsigned int tag;
+    long result;                // bytes transferred, or -errno
+} io_completion;
+
+struct async_io;
+
+typedef struct {
+    struct async_io *io;
+    io_request *requests;       // ring of depth requests
+    unsigned int head, tail;
+    pthread_t thread;
+} io_queue;
+
+typedef struct async_io {
+    char uring;
+    unsigned int depth;         // requests in flight per direction at most
+    // io_uring: the mapped submission and completion rings
+    int ring;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned int *sq_tail, *sq_mask, *sq_array, *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    // threads: reads and writes queue up separately, completions come back in one ring
+    io_queue queues[2];
+    io_completion *completions;
+    unsigned int completion_head, completion_tail;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    char stopping;
+} async_io;
+
+static int start_async_io(async_io *io, unsigned int depth);
+
+static void stop_async_io(async_io *io);
+
+static int start_uring(async_io *io, unsigned int depth);
+
+static int submit_io(async_io *io, const io_request *request);
+
+static int wait_io(async_io *io, io_completion *completion);
+
+static void *io_worker(void *arg);
+
+// pipeline: depth slots, each read, passed through stage in file order, then written after the previous ones
+typedef size_t (*pipeline_stage)(void *context, uint8_t *input, size_t length, char last, uint8_t *output);
+
+typedef enum {SLOT_FREE, SLOT_READING, SLOT_READ, SLOT_WRITING} slot_state;
+
+typedef struct {
+    slot_state state;
+    uint8_t *input;
+    uint8_t *output;
+    uint64_t offset;            // of the chunk in the input file
+    size_t length, done;        // chunk length and how much of it has been read
+    uint64_t output_offset;
+    size_t output_length, written;
+} pipeline_slot;
+
+static int run_pipeline(int input, int output, uint64_t input_size, size_t chunk_size, size_t output_size,
+                        pipeline_stage stage, void *context);
+
+static int crypt_pipelined(FILE *input, FILE *output, des_ctx *cipher, char decrypting);
+
+// memory-mapped binary mode
+static int encrypt_mapped(const char *input_name, const char *output_name, des_ctx *cipher);
+
+static int decrypt_mapped(const char *input_name, const char *output_name, des_ctx *cipher);
+
+// binary container format (all integers big-endian):
+//      0   magic           8 bytes, container_magic
+//      8   version         1 byte, CONTAINER_VERSION
+//      9   mode            1 byte, block_mode
+//      10  rounds          1 byte, 16 for DES or 48 for 3DES
+//      11  padding         1 byte, PKCS#5 bytes at the end of the data (1 to 8)
+//      12  chunk_size      4 bytes, ciphertext bytes per chunk (the last one may be shorter)
+//      16  iv              8 bytes
+//      24  plain_length    8 bytes
+//      32  chunk_count     8 bytes
+//      40  index_offset    8 bytes, the index follows the last chunk
+//      48  key_check       4 bytes, top half of E_K(E_K(salt)), see key_check_value
+//      52  salt            8 bytes, random per file
+//      60  reserved        4 bytes of zeros
+//      64  the chunks, then the index: per chunk its file offset and chain value (CBC: previous ciphertext block,
+//          CTR: counter of its first block), 8 bytes each
+typedef struct {
+    unsigned char version;
+    block_mode mode;
+    unsigned char rounds;
+    unsigned char padding;
+    uint32_t chunk_size;
+    uint64_t iv;
+    uint64_t plain_length;
+    uint64_t chunk_count;
+    uint64_t index_offset;
+    uint32_t key_check;
+    uint64_t salt;
+} container_header;
+
+static void encode_container_header(const container_header *header, uint8_t bytes[CONTAINER_HEADER_SIZE]);
+
+static int decode_container_header(const uint8_t bytes[CONTAINER_HEADER_SIZE], container_header *header);
+
+static uint32_t key_check_value(const des_ctx *cipher, uint64_t salt);
+
+static int encrypt_container(FILE *input, FILE *output, des_ctx *cipher);
+
+static int read_container(FILE *input, const des_ctx *cipher, container_header *header, uint8_t **index);
+
+static int decrypt_container(FILE *input, FILE *output, des_ctx *cipher);
+
+static int check_container_header(const container_header *header, const des_ctx *cipher);
+
+// random-access range decryption: block i of a container or of hex without separators sits at a computed offset,
+// any other hex is parsed from the front up to the range
+typedef enum {RANGE_CONTAINER, RANGE_DENSE_HEX, RANGE_SCANNED_HEX} range_format;
+
+typedef struct {
+    FILE *input;
+    range_format format;
+    uint64_t size_in_blocks;    // ciphertext blocks in the file, UINT64_MAX until a scan reaches the end
+    hex_parser parser;          // scanned hex: parser state and the blocks parsed so far
+    uint64_t parsed;
+} range_reader;
+
+static int open_range_reader(const char *input_name, const des_ctx *cipher, range_reader *reader,
+                             container_header *header);
+
+static int read_range_blocks(range_reader *reader, uint64_t first, size_t count, uint64_t *blocks, char *text,
+                             size_t *got);
+
+static int decrypt_range_blocks(range_reader *reader, des_ctx *cipher, FILE *output, uint64_t offset, uint64_t limit,
+                                uint64_t plain_length);
+
+static int decrypt_range(des_ctx *cipher, const char *input_name, const char *output_name, uint64_t offset,
+                         uint64_t length);
+
+// batch mode: one pool task per file, each worker thread keeps its buffers in its own arena
+typedef struct {
+    char *input;
+    char *output;
+    char collides;              // another entry writes the same output, so neither is processed
+} batch_file;
+
+typedef struct {
+    stream_stage stage;         // its scratch blocks, reused for every file
+    uint8_t *input;             // one chunk, plus room for the padding
+    uint8_t *output;
+} batch_arena;
+
+typedef struct {
+    des_ctx *cipher;
+    char decrypting;
+    const batch_file *files;
+    size_t chunk_size;
+    batch_arena *arenas;        // one per worker thread, set up by its first file
+    _Atomic uint64_t done, failed, input_bytes, output_bytes;
+} batch_job;
+
+static int list_batch_files(const char *input, const char *output_dir, batch_file **files, size_t *file_count);
+
+static int add_batch_file(batch_file **files, size_t *file_count, const char *input, const char *output_dir,
+                          const char *output);
+
+static void free_batch_files(batch_file *files, size_t file_count);
+
+static int compare_batch_outputs(const void *a, const void *b);
+
+static char *join_path(const char *directory, const char *name);
+
+static int crypt_batch_file(batch_job *job, const batch_file *file, batch_arena *arena);
+
+static void batch_task(void *context, uint64_t index);
+
+static int crypt_batch(des_ctx *cipher, const char *input, const char *output_dir, char decrypting,
+                       des_batch_stats *stats);
+
+// key search: a slice of the range per checkpoint interval, one pool task per SEARCH_TASK_KEYS keys of it
+typedef struct {
+    des_key_search *search;
+    const engine *engine;
+    uint64_t first;             // first index of task 0, a multiple of the engine width
+    uint64_t begin;             // keys of this slice
+    uint64_t end;
+    pthread_mutex_t lock;       // guards search->found
+} search_job;
+
+static const engine *search_engine(void);
+
+static void search_task(void *context, uint64_t task);
+
+static int check_key(const des_key_search *search, uint64_t key);
+
+static int read_search_checkpoint(const char *name, des_key_search *search);
+
+static int write_search_checkpoint(const char *name, const des_key_search *search);
+
+static int key_search(des_key_search *search, const char *checkpoint);
+
+static int key_search_self_test(void);
+
+// CBC streams: one pool task per group of streams as wide as the engine, the streams sorted by length so the ones
+// still running are always the first of their group
+typedef struct {
+    const des_ctx *cipher;
+    des_stream **order;         // longest first
+    size_t stream_count;
+    unsigned int lanes;         // streams per task
+    char decrypting;
+} stream_job;
+
+static int compare_stream_lengths(const void *a, const void *b);
+
+static void stream_task(void *context, uint64_t task);
+
+static int crypt_streams(des_ctx *cipher, des_stream *streams, size_t stream_count, char decrypting);
+
+static void inverse_initial_permutation(uint64_t input, uint64_t *output);
+
+static void expansion_d_box(uint64_t input, uint64_t *output);
+
+static void straight_permutation(uint64_t input, uint64_t *output);
+
+static void permuted_choice_1(uint64_t key, uint64_t *c, uint64_t *d);
+
+static void permuted_choice_2(uint64_t c, uint64_t d, uint64_t *key);
+
+// table-driven permutation functions
+static uint64_t byte_permute(uint64_t input, const uint64_t table[][256], unsigned char bytes);
+
+static void inverse_initial_permutation_fast(uint64_t input, uint64_t *output);
+
+static void permuted_choice_1_fast(uint64_t key, uint64_t *c, uint64_t *d);
+
+static void permuted_choice_2_fast(uint64_t c, uint64_t d, uint64_t *key);
+
+// key generation functions
+static void left_shift(uint64_t *key, unsigned char round);
+
+static void generate_schedule(const uint64_t *des_keys, unsigned int key_count, uint64_t keys[48],
+                              unsigned char *rounds);
+
+// encryption functions
+static void xor(uint64_t a, uint64_t b, uint64_t *result);
+
+static void swap(uint64_t *a, uint64_t *b);
+
+// bitsliced encryption functions (64 blocks per lane, see bitslice_engine.h)
+static void transpose_64x64(uint64_t matrix[64]);
+
+// engine selection
+static void table_crypt(const uint64_t *input, const uint64_t *keys, unsigned char rounds, char decrypting,
+                        uint64_t *output);
+
+static int engine_self_test(const engine *e);
+
+static void select_engine(void);
+
+static size_t crypt_lanes(const engine *widest, const uint64_t *input, const uint64_t *key_indices,
+                          unsigned char rounds, char decrypting, uint64_t *output, size_t size_in_blocks);
+
+static const uint64_t *cached_schedule(schedule_cache *cache, uint64_t key);
+
+// thread pool
+typedef struct {
+    _Atomic uint64_t range;     // next task in the top 32 bits, end of the range in the bottom 32
+    char padding[64 - sizeof(uint64_t)];   // one queue per cache line
+} task_queue;
+
+typedef struct {
+    unsigned int threads;
+    pthread_t *workers;
+    task_queue *queues;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t finished;
+    unsigned long generation;   // bumped for every parallel_for
+    unsigned int running;       // workers still busy with the current one
+    pthread_mutex_t submit;     // one parallel_for at a time when several threads share the pool
+    char stopping;
+    void (*task)(void *context, uint64_t index);
+    void *context;
+} thread_pool;
+
+static int start_thread_pool(unsigned int threads);
+
+static void stop_thread_pool(void);
+
+static int next_task(unsigned int self, uint64_t *index);
+
+static void *pool_worker(void *arg);
+
+static void parallel_for(uint64_t tasks, void (*task)(void *context, uint64_t index), void *context);
+
+// chunk processing (load, encrypt/decrypt and store a chunk of blocks on the thread pool)
+typedef struct {
+    des_ctx *cipher;
+    char decrypting;
+    uint64_t *blocks;             // results
+    size_t size_in_blocks;
+    const uint8_t *input_bytes;   // when set, blocks [0, input_blocks) are first loaded from here (big-endian)
+    size_t input_blocks;
+    const uint64_t *source;       // input blocks when not NULL, otherwise blocks is worked on in place
+    uint64_t chain;               // CBC: ciphertext block before this chunk, CTR: counter of its first block
+    char *output_text;            // when set, the results are hex encoded here
+    uint8_t *output_bytes;        // when set, the results are stored here (big-endian), may alias blocks
+    char serial;                  // run the tasks on the calling thread, e.g. from inside a pool task
+} chunk_job;
+
+static void chunk_task(void *context, uint64_t task);
+
+static uint64_t run_chunk(chunk_job *job);
+
+// ##################################################################################################################
+// Constants and Tables
+// ##################################################################################################################
+
+// Initial Permutation Table
+static const unsigned char initial_permutation_table[64] = {58, 50, 42, 34, 26, 18, 10, 2,
+                                                            60, 52, 44, 36, 28, 20, 12, 4,
+                                                            62, 54, 46, 38, 30, 22, 14, 6,
+                                                            64, 56, 48, 40, 32, 24, 16, 8,
+                                                            57, 49, 41, 33, 25, 17, 9, 1,
+                                                            59, 51, 43, 35, 27, 19, 11, 3,
+                                                            61, 53, 45, 37, 29, 21, 13, 5,
+                                                            63, 55, 47, 39, 31, 23, 15, 7};
+
+// Final Permutation Table
+static const unsigned char Final_permutation[64] = {40, 8, 48, 16, 56, 24, 64, 32,
+                                                                    39, 7, 47, 15, 55, 23, 63, 31,
+                                                                    38, 6, 46, 14, 54, 22, 62, 30,
+                                                                    37, 5, 45, 13, 53, 21, 61, 29,
+                                                                    36, 4, 44, 12, 52, 20, 60, 28,
+                                                                    35, 3, 43, 11, 51, 19, 59, 27,
+                                                                    34, 2, 42, 10, 50, 18, 58, 26,
+                                                                    33, 1, 41, 9, 49, 17, 57, 25};
+
+// Expansion D-box Table
+static const unsigned char expansion_d_box_table[48] = {32, 1, 2, 3, 4, 5, 4, 5,
+                                                        6, 7, 8, 9, 8, 9, 10, 11,
+                                                        12, 13, 12, 13, 14, 15, 16, 17,
+                                                        16, 17, 18, 19, 20, 21, 20, 21,
+                                                        22, 23, 24, 25, 24, 25, 26, 27,
+                                                        28, 29, 28, 29, 30, 31, 32, 1};
+
+// S-box Table
+static const unsigned char s_box_table[8][4][16] = {
+        // S1
+        {
+                {14, 4, 13, 1, 2, 15, 11, 8, 3, 10, 6, 12, 5, 9, 0, 7},
+                {0, 15, 7, 4, 14, 2, 13, 1, 10, 6, 12, 11, 9, 5, 3, 8},
+                {4, 1, 14, 8, 13, 6, 2, 11, 15, 12, 9, 7, 3, 10, 5, 0},
+                {15, 12, 8, 2, 4, 9, 1, 7, 5, 11, 3, 14, 10, 0, 6, 13}
+        },
+        // S2
+        {
+                {15, 1, 8, 14, 6, 11, 3, 4, 9, 7, 2, 13, 12, 0, 5, 10},
+                {3, 13, 4, 7, 15, 2, 8, 14, 12, 0, 1, 10, 6, 9, 11, 5},
+                {0, 14, 7, 11, 10, 4, 13, 1, 5, 8, 12, 6, 9, 3, 2, 15},
+                {13, 8, 10, 1, 3, 15, 4, 2, 11, 6, 7, 12, 0, 5, 14, 9}
+        },
+        // S3
+        {
+                {10, 0, 9, 14, 6, 3, 15, 5, 1, 13, 12, 7, 11, 4, 2, 8},
+                {13, 7, 0, 9 , 3, 4, 6, 10, 2, 8, 5, 14, 12, 11, 15,1},
+                {13, 6, 4, 9, 8, 15, 3, 0, 11, 1, 2, 12, 5, 10, 14, 7},
+                {1, 10, 13, 0, 6, 9, 8, 7, 4, 15, 14, 3, 11, 5, 2, 12}
+        },
+        // S4
+        {
+                {7, 13, 14, 3, 0, 6, 9, 10, 1, 2, 8, 5, 11, 12, 4, 15},
+                {13, 8, 11, 5, 6, 15, 0, 3, 4, 7, 2, 12, 1, 10, 14, 9},
+                {10, 6, 9, 0, 12, 11, 7, 13, 15, 1, 3, 14, 5, 2, 8, 4},
+                {3, 15, 0, 6, 10, 1, 13, 8, 9, 4, 5, 11, 12, 7, 2, 14}
+        },
+        // S5
+        {
+                {2, 12, 4, 1, 7, 10, 11, 6, 8, 5, 3, 15, 13, 0, 14, 9},
+                {14, 11, 2, 12, 4, 7, 13, 1, 5, 0, 15, 10, 3, 9, 8, 6},
+                {4, 2, 1, 11, 10, 13, 7, 8, 15, 9, 12, 5, 6, 3, 0, 14},
+                {11, 8, 12, 7, 1, 14, 2, 13, 6, 15, 0, 9, 10, 4, 5, 3}
+        },
+        // S6
+        {
+                {12, 1, 10, 15, 9, 2, 6, 8, 0, 13, 3, 4, 14, 7, 5, 11},
+                {10, 15, 4, 2, 7, 12, 9, 5, 6, 1, 13, 14, 0, 11, 3, 8},
+                {9, 14, 15, 5, 2, 8, 12, 3, 7, 0, 4, 10, 1, 13, 11, 6},
+                {4, 3, 2, 12, 9, 5, 15, 10, 11, 14, 1, 7, 6, 0, 8, 13}
+        },
+        // S7
+        {
+                {4, 11, 2, 14, 15, 0, 8, 13, 3, 12, 9, 7, 5, 10, 6, 1},
+                {13, 0, 11, 7, 4, 9, 1, 10, 14, 3, 5, 12, 2, 15, 8, 6},
+                {1, 4, 11, 13, 12, 3, 7, 14, 10, 15, 6, 8, 0, 5, 9, 2},
+                {6, 11, 13, 8, 1, 4, 10, 7, 9, 5, 0, 15, 14, 2, 3, 12}
+        },
+        // S8
+        {
+                {13, 2, 8, 4, 6, 15, 11, 1, 10, 9, 3, 14, 5, 0, 12, 7},
+                {1, 15, 13, 8, 10, 3, 7, 4, 12, 5, 6, 11, 0, 14, 9, 2},
+                {7, 11, 4, 1, 9, 12, 14, 2, 0, 6, 10, 13, 15, 3, 5, 8},
+                {2, 1, 14, 7, 4, 10, 8, 13, 15, 12, 9, 0, 3, 5, 6, 11}
+        }
+};
+
+// Straight Permutation Table
+static const unsigned char straight_permutation_table[32] = {16, 7, 20, 21,
+                                                             29, 12, 28, 17,
+                                                             1, 15, 23, 26,
+                                                             5, 18, 31, 10,
+                                                             2, 8, 24, 14,
+                                                             32, 27, 3, 9,
+                                                             19, 13, 30, 6,
+                                                             22, 11, 4, 25};
+
+// Permuted Choice 1 Table
+static const unsigned char permuted_choice_1_table[56] = {57, 49, 41, 33, 25, 17, 9,
+                                                          1, 58, 50, 42, 34, 26, 18,
+                                                          10, 2, 59, 51, 43, 35, 27,
+                                                          19, 11, 3, 60, 52, 44, 36,
+                                                          63, 55, 47, 39, 31, 23, 15,
+                                                          7, 62, 54, 46, 38, 30, 22,
+                                                          14, 6, 61, 53, 45, 37, 29,
+                                                          21, 13, 5, 28, 20, 12, 4};
+
+// Permuted Choice 2 Table
+static const unsigned char permuted_choice_2_table[48] = {14, 17, 11, 24, 1, 5,
+                                                          3, 28, 15, 6, 21, 10,
+                                                          23, 19, 12, 4, 26, 8,
+                                                          16, 7, 27, 20, 13, 2,
+                                                          41, 52, 31, 37, 47, 55,
+                                                          30, 40, 51, 45, 33, 48,
+                                                          44, 49, 39, 56, 34, 53,
+                                                          46, 42, 50, 36, 29, 32};
+
+// Left Shift Table
+static const unsigned char left_shift_table[16] = {1, 1, 2, 2,
+                                                   2, 2, 2, 2,
+                                                   1, 2, 2, 2,
+                                                   2, 2, 2, 1};
+
+// Bitslice S-box Leaves (s_box_table regrouped for the bitsliced engine)
+// bit m of bitslice_s_box_leaves[i][q][p] is output bit q (from the top) of S-box i for the 6-bit input (p << 2) | m,
+// so each entry is a Boolean function of the bottom two input bits for one value of the top four. A constant, so
+// the bitsliced S-boxes compile to fixed gates; des_bitslice_leaves_self_test checks it against s_box_table.
+static const unsigned char bitslice_s_box_leaves[8][4][16] = {
+        // S1
+        {
+                {9, 1, 6, 7, 6, 14, 6, 8, 10, 7, 9, 4, 13, 9, 6, 8},
+                {13, 11, 6, 2, 8, 7, 9, 4, 11, 1, 7, 8, 7, 12, 0, 11},
+                {9, 2, 15, 1, 15, 9, 0, 6, 2, 9, 4, 13, 9, 14, 7, 2},
+                {8, 7, 4, 11, 1, 8, 15, 6, 6, 0, 9, 14, 11, 7, 1, 9}
+        },
+        // S2
+        {
+                {9, 5, 6, 10, 3, 12, 9, 6, 14, 6, 9, 1, 6, 9, 1, 14},
+                {9, 14, 3, 12, 6, 4, 3, 9, 6, 1, 12, 3, 9, 15, 8, 6},
+                {3, 12, 15, 9, 4, 9, 2, 6, 4, 7, 11, 8, 10, 6, 4, 7},
+                {15, 8, 6, 1, 5, 6, 8, 11, 2, 13, 10, 5, 3, 2, 13, 12}
+        },
+        // S3
+        {
+                {3, 13, 0, 9, 12, 9, 11, 6, 9, 6, 13, 2, 9, 6, 6, 9},
+                {10, 4, 9, 7, 4, 15, 6, 2, 5, 3, 6, 8, 10, 6, 9, 13},
+                {9, 4, 7, 11, 2, 12, 9, 3, 12, 0, 6, 9, 9, 11, 6, 7},
+                {10, 9, 6, 5, 5, 6, 9, 10, 3, 6, 12, 9, 13, 8, 11, 4}
+        },
+        // S4
+        {
+                {14, 3, 8, 5, 0, 9, 13, 14, 9, 1, 7, 14, 3, 12, 2, 9},
+                {7, 9, 14, 0, 10, 12, 4, 7, 12, 8, 1, 7, 9, 6, 11, 12},
+                {1, 7, 14, 12, 12, 2, 9, 6, 15, 8, 6, 1, 1, 13, 12, 10},
+                {7, 14, 8, 9, 9, 4, 3, 12, 10, 1, 12, 7, 7, 11, 9, 0}
+        },
+        // S5
+        {
+                {14, 8, 4, 3, 1, 14, 9, 7, 10, 6, 13, 12, 13, 9, 2, 4},
+                {6, 9, 11, 6, 6, 6, 1, 9, 1, 10, 12, 9, 11, 5, 9, 6},
+                {11, 2, 13, 5, 0, 15, 2, 9, 6, 12, 9, 3, 11, 0, 7, 12},
+                {8, 4, 9, 11, 6, 7, 11, 4, 2, 13, 6, 9, 13, 12, 4, 10}
+        },
+        // S6
+        {
+                {11, 5, 9, 6, 4, 10, 9, 12, 5, 9, 6, 11, 10, 4, 4, 11},
+                {9, 6, 10, 9, 6, 14, 5, 1, 6, 13, 8, 3, 9, 9, 6, 12},
+                {10, 13, 6, 1, 2, 9, 13, 6, 12, 3, 1, 14, 11, 12, 2, 5},
+                {12, 4, 3, 10, 12, 3, 12, 7, 9, 5, 10, 6, 3, 10, 5, 9}
+        },
+        // S7
+        {
+                {6, 6, 9, 13, 6, 9, 12, 2, 8, 15, 1, 6, 7, 12, 2, 9},
+                {3, 12, 3, 4, 6, 14, 9, 9, 6, 6, 9, 13, 12, 9, 6, 8},
+                {4, 15, 1, 8, 11, 4, 14, 9, 10, 1, 4, 15, 5, 9, 10, 6},
+                {6, 10, 9, 6, 9, 7, 9, 4, 9, 7, 6, 9, 14, 8, 4, 3}
+        },
+        // S8
+        {
+                {9, 11, 6, 1, 7, 12, 8, 3, 4, 2, 13, 11, 10, 7, 1, 12},
+                {9, 6, 5, 10, 10, 6, 9, 5, 1, 11, 6, 9, 14, 4, 9, 3},
+                {12, 0, 15, 3, 1, 15, 8, 12, 7, 10, 8, 5, 6, 1, 7, 10},
+                {11, 2, 12, 7, 12, 9, 1, 6, 13, 12, 1, 8, 2, 6, 15, 9}
+        }
+};
+
+// Binary Container Magic (PNG style: a high bit byte, the name, then line endings and ^Z to catch text mode copies)
+static const uint8_t container_magic[8] = {0x89, 'D', 'E', 'S', '\r', '\n', 0x1A, '\n'};
+
+// Hex Digit Values (value + 1, 0 for anything that is not a hex digit)
+static const unsigned char hex_digit_values[256] = {
+        ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+        ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+        ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16
+};
+
+// Fused SP-box Tables (built by init_tables)
+// sp_box_table[i][v] is the straight permutation of S-box i's output for the 6-bit input v,
+// already placed at its final position in the 32-bit des_f_function output
+static uint32_t sp_box_table[8][64];
+
+// Byte-indexed Permutation Tables (built by init_tables)
+// entry [j][v] is the permutation of an input whose j-th byte (from the top) is v and all other bits are 0,
+// so a whole permutation is the OR of one lookup per input byte
+static uint64_t initial_permutation_lookup[8][256];
+static uint64_t final_permutation_lookup[8][256];
+static uint64_t permuted_choice_1_lookup[8][256];   // output is (c << 28) | d
+static uint64_t permuted_choice_2_lookup[7][256];   // input is (c << 28) | d
+
+// Position in the des_f_function output that each S-box output bit is moved to by the straight permutation
+// (built by init_tables)
+static unsigned char straight_permutation_inverse[32];
+
+// Key index bit (see des_key_from_index) that bit j (from the top) of round key i is, the key schedule of the
+// key search and of the per-block keys of crypt_lanes as a renaming (built by init_tables)
+static unsigned char round_key_planes[16][48];
+
+
+// ##################################################################################################################
+// ##################################################################################################################
+
+static thread_pool pool = {.threads = 1, .submit = PTHREAD_MUTEX_INITIALIZER};
+
+static _Thread_local unsigned int pool_self = 0;   // index of the calling pool worker, 0 outside the workers
+
+static pipeline_config pipeline = {.depth = PIPELINE_DEPTH, .chunk_size = 0};
+
+static _Thread_local thread_stats *stats_self = NULL;
+
+static thread_stats *stats_threads = NULL;
+static thread_stats stats_retired;     // the threads that have ended, added up
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#if DES_STATS
+static unsigned int stats_next_index = 0;
+static uint64_t stats_start_ticks;
+#endif
+static struct timespec stats_start_time;
+
+// ##################################################################################################################
+// Function Definitions
+// ##################################################################################################################
+
+
+static void init_tables(void) {
+    // Merge each S-box with the straight permutation
+    LOOP(i, 8) {
+        LOOP(v, 64) {
+            unsigned char row = ((v & 0x20) >> 4) | (v & 1);
+            unsigned char col = (v >> 1) & 0xF;
+
+            uint64_t s_box_output = (uint64_t)s_box_table[i][row][col] << (32 - (i + 1) * 4);
+            uint64_t permuted;
+            straight_permutation(s_box_output, &permuted);
+            sp_box_table[i][v] = (uint32_t)permuted;
+        }
+    }
+
+    LOOP(i, 32) {
+        straight_permutation_inverse[straight_permutation_table[i] - 1] = i;
+    }
+
+    // Run every single-byte input through the bit-by-bit permutations
+    LOOP(j, 8) {
+        for (unsigned int v = 0; v < 256; v++) {
+            uint64_t input = (uint64_t)v << (56 - j * 8);
+            uint64_t c, d;
+
+            des_initial_permutation(input, &initial_permutation_lookup[j][v]);
+            inverse_initial_permutation(input, &final_permutation_lookup[j][v]);
+
+            permuted_choice_1(input, &c, &d);
+            permuted_choice_1_lookup[j][v] = (c << 28) | d;
+
+            if (j < 7) {
+                input >>= 8;
+                permuted_choice_2(input >> 28, input & 0xFFFFFFF, &permuted_choice_2_lookup[j][v]);
+            }
+        }
+    }
+
+    // The key schedule only moves bits around, so a key with one bit set shows where that bit ends up
+    LOOP(b, 56) {
+        uint64_t keys[16];
+        des_generate_keys_reference(des_key_from_index((uint64_t)1 << b), keys);
+        LOOP(i, 16) {
+            LOOP(j, 48) {
+                if ((keys[i] >> (47 - j)) & 1)
+                    round_key_planes[i][j] = b;
+            }
+        }
+    }
+}
+
+
+uint64_t des_load_block(const uint8_t bytes[8]) {
+    // Blocks are stored big-endian (first byte is the top byte)
+    uint64_t block;
+    memcpy(&block, bytes, 8);
+    return be64toh(block);
+}
+
+void des_store_block(uint64_t block, uint8_t bytes[8]) {
+    block = htobe64(block);
+    memcpy(bytes, &block, 8);
+}
+
+size_t des_parse_hex(const char *text, size_t length, hex_parser *parser, uint64_t *blocks) {
+    STATS_START(parsing);
+    size_t count = des_selected_hex_codec->parse(text, length, parser, blocks);
+    STATS_STOP(parsing, PHASE_PARSE, length);
+    return count;
+}
+
+static void encode_hex(const uint64_t *blocks, size_t size_in_blocks, char *text) {
+    STATS_START(encoding);
+    des_selected_hex_codec->encode(blocks, size_in_blocks, text);
+    STATS_STOP(encoding, PHASE_ENCODE, size_in_blocks * 16);
+}
+
+static int padding_length(uint64_t block) {
+    // PKCS#5: the last byte says how many bytes of padding there are (1 to 8), and all of them hold that value
+    unsigned char padding = block & 0xFF;
+    if (padding < 1 || padding > 8)
+        return -1;
+    LOOP(j, padding) {
+        if (((block >> (j * 8)) & 0xFF) != padding)
+            return -1;
+    }
+    return padding;
+}
+
+int des_read_hex_blocks(const char *filename, uint64_t *blocks, unsigned int *size_in_blocks) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+        perror(filename);
+        return 1;
+    }
+
+    char text[256];
+    size_t length = fread(text, 1, sizeof(text), fp);
+    fclose(fp);
+
+    // Parse at most *size_in_blocks values, anything after them is ignored
+    uint64_t parsed[sizeof(text) / 16];
+    hex_parser parser = {0, 0};
+    size_t count = des_parse_hex(text, length, &parser, parsed);
+    if (count == 0) {
+        fprintf(stderr, "Error: %s must start with a 64-bit value (16 hex digits)\n", filename);
+        return 1;
+    }
+    if (count < *size_in_blocks)
+        *size_in_blocks = count;
+    memcpy(blocks, parsed, *size_in_blocks * sizeof(uint64_t));
+    return 0;
+}
+
+static int encrypt_stream(FILE *input, FILE *output, des_ctx *cipher) {
+    // One chunk at a time, plus room to pad the last block in place
+    size_t chunk_size = stream_chunk_size();
+    stream_stage stage;
+    uint8_t *bytes = malloc(chunk_size + 8);
+    uint8_t *text = malloc(2 * chunk_size + 16);
+    if (bytes == NULL || text == NULL || init_stream_stage(&stage, cipher, chunk_size, 0) != 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(bytes);
+        free(text);
+        return 1;
+    }
+
+    int status = 0;
+    for (;;) {
+        STATS_START(reading);
+        size_t length = fread(bytes, 1, chunk_size, input);
+        STATS_STOP(reading, PHASE_READ, length);
+        if (ferror(input)) {
+            perror("Error reading input file");
+            status = 1;
+            break;
+        }
+
+        // A short read means end of file
+        char last = length < chunk_size;
+        size_t text_length = encrypt_hex_stage(&stage, bytes, length, last, text);
+        STATS_START(writing);
+        char failed = fwrite(text, 1, text_length, output) != text_length;
+        STATS_STOP(writing, PHASE_WRITE, text_length);
+        if (failed) {
+            perror("Error writing hex data to file");
+            status = 1;
+            break;
+        }
+        if (last)
+            break;
+    }
+
+    free_stream_stage(&stage);
+    free(bytes);
+    free(text);
+    return status;
+}
+
+static int decrypt_stream(FILE *input, FILE *output, des_ctx *cipher, const uint8_t *prefix, size_t prefix_length) {
+    size_t chunk_size = stream_chunk_size();
+    stream_stage stage;
+    char *text = malloc(chunk_size);
+    uint8_t *bytes = malloc(chunk_size / 2 + 16);
+    if (text == NULL || bytes == NULL || init_stream_stage(&stage, cipher, chunk_size, 1) != 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(text);
+        free(bytes);
+        return 1;
+    }
+
+    // Bytes the caller has already read from a pipe (to sniff for a container) go in front of the first chunk
+    memcpy(text, prefix, prefix_length);
+    int status = 0;
+    for (;;) {
+        STATS_START(reading);
+        size_t length = prefix_length + fread(&text[prefix_length], 1, chunk_size - prefix_length, input);
+        STATS_STOP(reading, PHASE_READ, length);
+        prefix_length = 0;
+        if (ferror(input)) {
+            perror("Error reading input file");
+            status = 1;
+            break;
+        }
+
+        char last = length < chunk_size;
+        size_t plain = decrypt_hex_stage(&stage, (uint8_t *)text, length, last, bytes);
+        STATS_START(writing);
+        char failed = fwrite(bytes, 1, plain, output) != plain;
+        STATS_STOP(writing, PHASE_WRITE, plain);
+        if (failed) {
+            perror("Error writing to file");
+            status = 1;
+            break;
+        }
+        if (last)
+            break;
+    }
+
+    free_stream_stage(&stage);
+    free(text);
+    free(bytes);
+    return status;
+}
+
+static size_t stream_chunk_size(void) {
+    return pipeline.chunk_size != 0 ? pipeline.chunk_size : (size_t)CHUNK_SIZE * pool.threads;
+}
+
+static int init_stream_stage(stream_stage *stage, des_ctx *cipher, size_t chunk_size, char decrypting) {
+    memset(stage, 0, sizeof(*stage));
+    stage->cipher = cipher;
+    stage->chain = cipher->iv;
+
+    // Encryption turns a chunk (plus the padding) into chunk_size / 8 + 1 blocks, decryption parses at most
+    // chunk_size / 16 + 1 of them out of the hex
+    stage->blocks = malloc((decrypting ? chunk_size / 16 + 1 : chunk_size / 8 + 1) * sizeof(uint64_t));
+    if (decrypting)
+        stage->cipher_text = malloc((chunk_size / 16 + 1) * sizeof(uint64_t));
+    if (stage->blocks == NULL || (decrypting && stage->cipher_text == NULL)) {
+        free_stream_stage(stage);
+        return 1;
+    }
+    return 0;
+}
+
+static void free_stream_stage(stream_stage *stage) {
+    free(stage->blocks);
+    free(stage->cipher_text);
+    stage->blocks = NULL;
+    stage->cipher_text = NULL;
+}
+
+static size_t encrypt_hex_stage(void *context, uint8_t *input, size_t length, char last, uint8_t *output) {
+    stream_stage *stage = context;
+
+    // PKCS#5 pads the leftover bytes of the last chunk to a full block, or adds a whole block of padding if
+    // there are none
+    if (last) {
+        unsigned char padding = 8 - length % 8;
+        memset(&input[length], padding, padding);
+        length += padding;
+    }
+
+    // Load, encrypt and hex encode the chunk on the thread pool
+    chunk_job job = {.cipher = stage->cipher, .decrypting = 0, .blocks = stage->blocks, .size_in_blocks = length / 8,
+                     .input_bytes = input, .input_blocks = length / 8, .chain = stage->chain,
+                     .output_text = (char *)output, .serial = stage->serial};
+    stage->chain = run_chunk(&job);
+    return length * 2;
+}
+
+static size_t decrypt_hex_stage(void *context, uint8_t *input, size_t length, char last, uint8_t *output) {
+    stream_stage *stage = context;
+    size_t plain = 0;
+
+    size_t size_in_blocks = stage->serial ?
+                            des_parse_hex((const char *)input, length, &stage->parser, stage->cipher_text) :
+                            des_parse_hex_parallel((const char *)input, length, &stage->parser, stage->cipher_text);
+    if (size_in_blocks > 0) {
+        // The previously held block goes in front of the new ones, the newest one is held back in turn
+        chunk_job job = {.cipher = stage->cipher, .decrypting = 1, .blocks = stage->blocks,
+                         .size_in_blocks = size_in_blocks, .source = stage->cipher_text, .chain = stage->chain,
+                         .output_bytes = stage->holding ? &output[8] : output, .serial = stage->serial};
+        stage->chain = run_chunk(&job);
+        if (stage->holding)
+            des_store_block(stage->held, output);
+        plain = (stage->holding ? 8 : 0) + (size_in_blocks - 1) * 8;
+        stage->held = stage->blocks[size_in_blocks - 1];
+        stage->holding = 1;
+    }
+    if (!last)
+        return plain;
+
+    if (stage->parser.digits != 0)
+        fprintf(stderr, "Warning: ciphertext ends with %u hex digits that do not make a full block, ignoring them\n",
+                        stage->parser.digits);
+
+    // Strip the PKCS#5 padding from the final block
+    if (stage->holding) {
+        int padding = padding_length(stage->held);
+        if (padding < 0) {
+            fprintf(stderr, "Warning: invalid padding in the last block, writing it unchanged\n");
+            padding = 0;
+        }
+
+        uint8_t tail[8];
+        des_store_block(stage->held, tail);
+        memcpy(&output[plain], tail, 8 - padding);
+        plain += 8 - padding;
+        stage->holding = 0;
+    }
+    return plain;
+}
+
+static int crypt_pipelined(FILE *input, FILE *output, des_ctx *cipher, char decrypting) {
+    struct stat info;
+    if (fstat(fileno(input), &info) != 0) {
+        perror("Error reading input file");
+        return 1;
+    }
+
+    size_t chunk_size = stream_chunk_size();
+    stream_stage stage;
+    if (init_stream_stage(&stage, cipher, chunk_size, decrypting) != 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    int status = decrypting ? run_pipeline(fileno(input), fileno(output), info.st_size, chunk_size,
+                                           chunk_size / 2 + 16, decrypt_hex_stage, &stage)
+                            : run_pipeline(fileno(input), fileno(output), info.st_size, chunk_size,
+                                           2 * chunk_size + 16, encrypt_hex_stage, &stage);
+    free_stream_stage(&stage);
+    return status;
+}
+
+static int run_pipeline(int input, int output, uint64_t input_size, size_t chunk_size, size_t output_size,
+                        pipeline_stage stage, void *context) {
+    async_io io;
+    unsigned int depth = pipeline.depth;
+    pipeline_slot *slots = calloc(depth, sizeof(pipeline_slot));
+    if (slots == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    // Input buffers keep 8 bytes of room for the padding
+    int status = 0;
+    for (unsigned int i = 0; i < depth && status == 0; i++) {
+        slots[i].input = malloc(chunk_size + 8);
+        slots[i].output = malloc(output_size);
+        if (slots[i].input == NULL || slots[i].output == NULL) {
+            fprintf(stderr, "Error: out of memory\n");
+            status = 1;
+        }
+    }
+    if (status == 0 && start_async_io(&io, depth) != 0)
+        status = 1;
+    char started = status == 0;
+
+    // Chunk N is read into slot N % depth once the write of chunk N - depth is done. The last chunk may be
+    // empty, it still goes through the stage to finish the padding.
+    uint64_t chunks = input_size / chunk_size + 1;
+    uint64_t next_read = 0, next_stage = 0, output_offset = 0;
+    unsigned int in_flight = 0;
+    while (status == 0 && (next_stage < chunks || in_flight > 0)) {
+        while (next_read < chunks && slots[next_read % depth].state == SLOT_FREE && status == 0) {
+            pipeline_slot *slot = &slots[next_read % depth];
+            slot->offset = next_read * chunk_size;
+            slot->length = input_size - slot->offset < chunk_size ? input_size - slot->offset : chunk_size;
+            slot->done = 0;
+            slot->state = SLOT_READ;
+            if (slot->length > 0) {
+                io_request request = {.fd = input, .writing = 0, .buffer = slot->input, .length = slot->length,
+                                      .offset = slot->offset, .tag = next_read % depth};
+                slot->state = SLOT_READING;
+                status = submit_io(&io, &request);
+                in_flight += status == 0;
+            }
+            next_read++;
+        }
+
+        // Run the stage as soon as the oldest chunk is in, the reads and writes around it carry on meanwhile
+        pipeline_slot *slot = &slots[next_stage % depth];
+        if (status == 0 && next_stage < chunks && slot->state == SLOT_READ) {
+            slot->output_length = stage(context, slot->input, slot->length, next_stage + 1 == chunks, slot->output);
+            slot->output_offset = output_offset;
+            slot->written = 0;
+            output_offset += slot->output_length;
+            slot->state = SLOT_FREE;
+            if (slot->output_length > 0) {
+                io_request request = {.fd = output, .writing = 1, .buffer = slot->output,
+                                      .length = slot->output_length, .offset = slot->output_offset,
+                                      .tag = next_stage % depth};
+                slot->state = SLOT_WRITING;
+                status = submit_io(&io, &request);
+                in_flight += status == 0;
+            }
+            next_stage++;
+            continue;
+        }
+
+        // Otherwise wait for the next read or write to finish, short ones are resubmitted for the rest
+        io_completion completion;
+        if (status != 0 || wait_io(&io, &completion) != 0) {
+            status = 1;
+            break;
+        }
+        in_flight--;
+        slot = &slots[completion.tag];
+        char writing = slot->state == SLOT_WRITING;
+        if (completion.result < 0) {
+            fprintf(stderr, "%s: %s\n", writing ? "Error writing to file" : "Error reading input file",
+                            strerror(-completion.result));
+            status = 1;
+            break;
+        }
+        if (completion.result == 0) {
+            fprintf(stderr, writing ? "Error writing to file: nothing was written\n"
+                                    : "Error: the input file got shorter while it was read\n");
+            status = 1;
+            break;
+        }
+        size_t *done = writing ? &slot->written : &slot->done;
+        size_t length = writing ? slot->output_length : slot->length;
+        *done += completion.result;
+        if (*done < length) {
+            io_request request = {.fd = writing ? output : input, .writing = writing,
+                                  .buffer = (writing ? slot->output : slot->input) + *done, .length = length - *done,
+                                  .offset = (writing ? slot->output_offset : slot->offset) + *done,
+                                  .tag = completion.tag};
+            status = submit_io(&io, &request);
+            in_flight += status == 0;
+        } else {
+            slot->state = writing ? SLOT_FREE : SLOT_READ;
+        }
+    }
+
+    // After an error, let everything still in flight land before the buffers go away
+    io_completion completion;
+    while (started && in_flight > 0 && wait_io(&io, &completion) == 0)
+        in_flight--;
+
+    if (started)
+        stop_async_io(&io);
+    for (unsigned int i = 0; i < depth; i++) {
+        free(slots[i].input);
+        free(slots[i].output);
+    }
+    free(slots);
+    return status;
+}
+
+static int start_async_io(async_io *io, unsigned int depth) {
+    memset(io, 0, sizeof(*io));
+    io->depth = depth;
+    io->ring = -1;
+
+    // io_uring unless DES_IO says otherwise or the kernel does not have it (then quietly the threads)
+    const char *forced = getenv("DES_IO");
+    if ((forced == NULL || strcmp(forced, "threads") != 0) && start_uring(io, depth) == 0)
+        return 0;
+    if (forced != NULL && strcmp(forced, "uring") == 0)
+        fprintf(stderr, "Warning: io_uring is not available, using I/O threads\n");
+
+    io->completions = calloc(2 * depth, sizeof(io_completion));
+    io->queues[0].requests = calloc(depth, sizeof(io_request));
+    io->queues[1].requests = calloc(depth, sizeof(io_request));
+    if (io->completions == NULL || io->queues[0].requests == NULL || io->queues[1].requests == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(io->completions);
+        free(io->queues[0].requests);
+        free(io->queues[1].requests);
+        return 1;
+    }
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->changed, NULL);
+
+    LOOP(i, 2) {
+        io->queues[i].io = io;
+        if (pthread_create(&io->queues[i].thread, NULL, io_worker, &io->queues[i]) != 0) {
+            perror("Error starting I/O thread");
+            if (i == 1) {
+                pthread_mutex_lock(&io->lock);
+                io->stopping = 1;
+                pthread_cond_broadcast(&io->changed);
+                pthread_mutex_unlock(&io->lock);
+                pthread_join(io->queues[0].thread, NULL);
+            }
+            free(io->completions);
+            free(io->queues[0].requests);
+            free(io->queues[1].requests);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void stop_async_io(async_io *io) {
+#ifdef __NR_io_uring_setup
+    if (io->uring) {
+        munmap(io->sqes, io->sqes_size);
+        if (io->cq_ring != io->sq_ring)
+            munmap(io->cq_ring, io->cq_ring_size);
+        munmap(io->sq_ring, io->sq_ring_size);
+        close(io->ring);
+        return;
+    }
+#endif
+
+    pthread_mutex_lock(&io->lock);
+    io->stopping = 1;
+    pthread_cond_broadcast(&io->changed);
+    pthread_mutex_unlock(&io->lock);
+    LOOP(i, 2) {
+        pthread_join(io->queues[i].thread, NULL);
+        free(io->queues[i].requests);
+    }
+    free(io->completions);
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->changed);
+}
+
+static int start_uring(async_io *io, unsigned int depth) {
+#ifdef __NR_io_uring_setup
+    // Room for a read and a write per slot
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring = syscall(__NR_io_uring_setup, 2 * depth, &params);
+    if (ring < 0)
+        return 1;
+
+    // IORING_OP_READ/WRITE came with IORING_FEAT_RW_CUR_POS (Linux 5.6)
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(ring);
+        return 1;
+    }
+
+    io->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    io->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    io->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    char single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && io->cq_ring_size > io->sq_ring_size)
+        io->sq_ring_size = io->cq_ring_size;
+
+    io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                       IORING_OFF_SQ_RING);
+    io->cq_ring = single_mmap || io->sq_ring == MAP_FAILED ? io->sq_ring
+                : mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                       IORING_OFF_CQ_RING);
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (io->sq_ring == MAP_FAILED || io->cq_ring == MAP_FAILED || io->sqes == MAP_FAILED) {
+        if (io->sqes != MAP_FAILED)
+            munmap(io->sqes, io->sqes_size);
+        if (io->cq_ring != MAP_FAILED && io->cq_ring != io->sq_ring)
+            munmap(io->cq_ring, io->cq_ring_size);
+        if (io->sq_ring != MAP_FAILED)
+            munmap(io->sq_ring, io->sq_ring_size);
+        close(ring);
+        return 1;
+    }
+
+    uint8_t *sq = io->sq_ring, *cq = io->cq_ring;
+    io->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+    io->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+    io->sq_array = (unsigned int *)(sq + params.sq_off.array);
+    io->cq_head = (unsigned int *)(cq + params.cq_off.head);
+    io->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+    io->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    io->ring = ring;
+    io->uring = 1;
+    return 0;
+#else
+    (void)io;
+    (void)depth;
+    return 1;
+#endif
+}
+
+static int submit_io(async_io *io, const io_request *request) {
+#ifdef __NR_io_uring_setup
+    if (io->uring) {
+        // This thread is the only producer, the kernel only needs to see the new tail after the entry
+        unsigned int tail = *io->sq_tail;
+        unsigned int index = tail & *io->sq_mask;
+        struct io_uring_sqe *sqe = &io->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = request->writing ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = request->fd;
+        sqe->addr = (uintptr_t)request->buffer;
+        sqe->len = request->length;
+        sqe->off = request->offset;
+        sqe->user_data = request->tag;
+        io->sq_array[index] = index;
+        __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        while (syscall(__NR_io_uring_enter, io->ring, 1, 0, 0, NULL, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                perror("Error submitting I/O");
+                return 1;
+            }
+        }
+        return 0;
+    }
+#endif
+
+    io_queue *queue = &io->queues[request->writing != 0];
+    pthread_mutex_lock(&io->lock);
+    queue->requests[queue->tail++ % io->depth] = *request;
+    pthread_cond_broadcast(&io->changed);
+    pthread_mutex_unlock(&io->lock);
+    return 0;
+}
+
+static int wait_io(async_io *io, io_completion *completion) {
+    // Time blocked here is I/O the cipher could not hide
+    STATS_START(waiting);
+#ifdef __NR_io_uring_setup
+    if (io->uring) {
+        for (;;) {
+            unsigned int head = *io->cq_head;
+            if (head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)) {
+                struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+                completion->tag = cqe->user_data;
+                completion->result = cqe->res;
+                __atomic_store_n(io->cq_head, head + 1, __ATOMIC_RELEASE);
+                STATS_STOP(waiting, PHASE_WAIT, 0);
+                return 0;
+            }
+            if (syscall(__NR_io_uring_enter, io->ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+                perror("Error waiting for I/O");
+                return 1;
+            }
+        }
+    }
+#endif
+
+    pthread_mutex_lock(&io->lock);
+    while (io->completion_head == io->completion_tail)
+        pthread_cond_wait(&io->changed, &io->lock);
+    *completion = io->completions[io->completion_head++ % (2 * io->depth)];
+    pthread_mutex_unlock(&io->lock);
+    STATS_STOP(waiting, PHASE_WAIT, 0);
+    return 0;
+}
+
+static void *io_worker(void *arg) {
+    io_queue *queue = arg;
+    async_io *io = queue->io;
+
+    // Take requests in order, do them with the lock dropped, and post the result
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        while (queue->head == queue->tail && !io->stopping)
+            pthread_cond_wait(&io->changed, &io->lock);
+        if (queue->head == queue->tail)
+            break;
+        io_request request = queue->requests[queue->head++ % io->depth];
+        pthread_mutex_unlock(&io->lock);
+
+        STATS_START(transfer);
+        ssize_t result = request.writing ? pwrite(request.fd, request.buffer, request.length, request.offset)
+                                         : pread(request.fd, request.buffer, request.length, request.offset);
+        STATS_STOP(transfer, request.writing ? PHASE_WRITE : PHASE_READ, result > 0 ? result : 0);
+        io_completion completion = {.tag = request.tag, .result = result < 0 ? -errno : result};
+
+        pthread_mutex_lock(&io->lock);
+        io->completions[io->completion_tail++ % (2 * io->depth)] = completion;
+        pthread_cond_broadcast(&io->changed);
+    }
+    pthread_mutex_unlock(&io->lock);
+    stats_retire();
+    return NULL;
+}
+
+static void encode_container_header(const container_header *header, uint8_t bytes[CONTAINER_HEADER_SIZE]) {
+    uint32_t chunk_size = htobe32(header->chunk_size);
+    uint32_t key_check = htobe32(header->key_check);
+
+    memset(bytes, 0, CONTAINER_HEADER_SIZE);
+    memcpy(bytes, container_magic, 8);
+    bytes[8] = header->version;
+    bytes[9] = header->mode;
+    bytes[10] = header->rounds;
+    bytes[11] = header->padding;
+    memcpy(&bytes[12], &chunk_size, 4);
+    des_store_block(header->iv, &bytes[16]);
+    des_store_block(header->plain_length, &bytes[24]);
+    des_store_block(header->chunk_count, &bytes[32]);
+    des_store_block(header->index_offset, &bytes[40]);
+    memcpy(&bytes[48], &key_check, 4);
+    des_store_block(header->salt, &bytes[52]);
+}
+
+static int decode_container_header(const uint8_t bytes[CONTAINER_HEADER_SIZE], container_header *header) {
+    if (memcmp(bytes, container_magic, 8) != 0)
+        return 1;
+
+    uint32_t chunk_size, key_check;
+    memcpy(&chunk_size, &bytes[12], 4);
+    memcpy(&key_check, &bytes[48], 4);
+    header->version = bytes[8];
+    header->mode = bytes[9];
+    header->rounds = bytes[10];
+    header->padding = bytes[11];
+    header->chunk_size = be32toh(chunk_size);
+    header->iv = des_load_block(&bytes[16]);
+    header->plain_length = des_load_block(&bytes[24]);
+    header->chunk_count = des_load_block(&bytes[32]);
+    header->index_offset = des_load_block(&bytes[40]);
+    header->key_check = be32toh(key_check);
+    header->salt = des_load_block(&bytes[52]);
+    return 0;
+}
+
+static uint32_t key_check_value(const des_ctx *cipher, uint64_t salt) {
+    // The usual check value, the top of E_K(0), hands a key search a known plaintext/ciphertext pair that is the
+    // same in every file. Encrypting a random salt twice gives away neither: the inner block stays secret and the
+    // salt rules out tables computed in advance. Trying a key against it still costs only two encryptions.
+    uint64_t check;
+    des_crypt_block(salt, cipher->keys, cipher->rounds, 0, &check);
+    des_crypt_block(check, cipher->keys, cipher->rounds, 0, &check);
+    return check >> 32;
+}
+
+static int encrypt_container(FILE *input, FILE *output, des_ctx *cipher) {
+    // Whole container chunks per read (one per thread), plus room to pad the last block
+    size_t chunk_size = (size_t)CHUNK_SIZE * pool.threads;
+    uint8_t *bytes = malloc(chunk_size + 8);
+    size_t index_capacity = 64;
+    uint8_t *index = malloc(index_capacity * CONTAINER_INDEX_ENTRY);
+    if (bytes == NULL || index == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(bytes);
+        free(index);
+        return 1;
+    }
+
+    container_header header = {.version = CONTAINER_VERSION, .mode = cipher->mode, .rounds = cipher->rounds,
+                               .chunk_size = CHUNK_SIZE, .iv = cipher->iv};
+    if (getrandom(&header.salt, sizeof(header.salt), 0) != sizeof(header.salt)) {
+        perror("Error generating the key check salt");
+        free(bytes);
+        free(index);
+        return 1;
+    }
+    header.key_check = key_check_value(cipher, header.salt);
+    uint8_t header_bytes[CONTAINER_HEADER_SIZE];
+
+    // The header is written again at the end, once the lengths and the index position are known
+    encode_container_header(&header, header_bytes);
+    int status = fwrite(header_bytes, 1, CONTAINER_HEADER_SIZE, output) != CONTAINER_HEADER_SIZE;
+    des_ctx stream = *cipher;
+    stream.chain = cipher->iv;
+    uint64_t offset = CONTAINER_HEADER_SIZE;
+
+    while (status == 0) {
+        STATS_START(reading);
+        size_t length = fread(bytes, 1, chunk_size, input);
+        STATS_STOP(reading, PHASE_READ, length);
+        if (ferror(input)) {
+            perror("Error reading input file");
+            status = 1;
+            break;
+        }
+        header.plain_length += length;
+
+        // PKCS#5 as in the hex format
+        char last = length < chunk_size;
+        if (last) {
+            header.padding = 8 - length % 8;
+            memset(&bytes[length], header.padding, header.padding);
+            length += header.padding;
+        }
+
+        uint64_t counter = stream.chain;
+        if (crypt_buffer(&stream, bytes, bytes, length, 0) != 0) {
+            status = 1;
+            break;
+        }
+
+        // One index entry per container chunk: where it starts and what it chains on from
+        for (size_t first = 0; first < length; first += CHUNK_SIZE) {
+            if (header.chunk_count == index_capacity) {
+                index_capacity *= 2;
+                uint8_t *grown = realloc(index, index_capacity * CONTAINER_INDEX_ENTRY);
+                if (grown == NULL) {
+                    fprintf(stderr, "Error: out of memory\n");
+                    status = 1;
+                    break;
+                }
+                index = grown;
+            }
+            uint64_t chain = 0;
+            if (cipher->mode == DES_MODE_CBC)
+                chain = first == 0 ? counter : des_load_block(&bytes[first - 8]);
+            else if (cipher->mode == DES_MODE_CTR)
+                chain = counter + first / 8;
+            des_store_block(offset + first, &index[header.chunk_count * CONTAINER_INDEX_ENTRY]);
+            des_store_block(chain, &index[header.chunk_count * CONTAINER_INDEX_ENTRY + 8]);
+            header.chunk_count++;
+        }
+
+        STATS_START(writing);
+        if (status == 0 && fwrite(bytes, 1, length, output) != length) {
+            perror("Error writing to file");
+            status = 1;
+        }
+        STATS_STOP(writing, PHASE_WRITE, length);
+        offset += length;
+        if (last)
+            break;
+    }
+
+    // Index after the last chunk, then the final header over the placeholder
+    if (status == 0) {
+        header.index_offset = offset;
+        encode_container_header(&header, header_bytes);
+        if (fwrite(index, CONTAINER_INDEX_ENTRY, header.chunk_count, output) != header.chunk_count ||
+            fseek(output, 0, SEEK_SET) != 0 || fwrite(header_bytes, 1, CONTAINER_HEADER_SIZE, output) != CONTAINER_HEADER_SIZE) {
+            perror("Error writing the container header");
+            status = 1;
+        }
+    }
+
+    free(bytes);
+    free(index);
+    return status;
+}
+
+static int read_container(FILE *input, const des_ctx *cipher, container_header *header, uint8_t **index) {
+    uint8_t header_bytes[CONTAINER_HEADER_SIZE];
+    if (fread(header_bytes, 1, CONTAINER_HEADER_SIZE, input) != CONTAINER_HEADER_SIZE ||
+        decode_container_header(header_bytes, header) != 0) {
+        fprintf(stderr, "Error: not a DES container\n");
+        return 1;
+    }
+
+    if (check_container_header(header, cipher) != 0)
+        return 1;
+
+    // The chunk count comes from the file, so the index it implies must fit in the file before it is allocated
+    struct stat info;
+    if (fstat(fileno(input), &info) != 0 || (uint64_t)info.st_size < header->index_offset ||
+        header->chunk_count > ((uint64_t)info.st_size - header->index_offset) / CONTAINER_INDEX_ENTRY) {
+        fprintf(stderr, "Error: the container index is missing or cut short\n");
+        return 1;
+    }
+    *index = malloc(header->chunk_count * CONTAINER_INDEX_ENTRY);
+    if (*index == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    if (fseeko(input, header->index_offset, SEEK_SET) != 0 ||
+        fread(*index, CONTAINER_INDEX_ENTRY, header->chunk_count, input) != header->chunk_count) {
+        fprintf(stderr, "Error: the container index is missing or cut short\n");
+        free(*index);
+        return 1;
+    }
+    for (uint64_t i = 0; i < header->chunk_count; i++) {
+        if (des_load_block(&(*index)[i * CONTAINER_INDEX_ENTRY]) != CONTAINER_HEADER_SIZE + i * header->chunk_size) {
+            fprintf(stderr, "Error: damaged container index\n");
+            free(*index);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int decrypt_container(FILE *input, FILE *output, des_ctx *cipher) {
+    container_header header;
+    uint8_t *index;
+    if (read_container(input, cipher, &header, &index) != 0)
+        return 1;
+
+    // The mode and IV come from the header, so they need not be given again
+    des_ctx stream = *cipher;
+    stream.mode = header.mode;
+    stream.iv = header.iv;
+
+    size_t chunks_per_read = pool.threads;
+    size_t read_size = (size_t)header.chunk_size * chunks_per_read;
+    uint8_t *bytes = malloc(read_size);
+    if (bytes == NULL || fseeko(input, CONTAINER_HEADER_SIZE, SEEK_SET) != 0) {
+        fprintf(stderr, bytes == NULL ? "Error: out of memory\n" : "Error: cannot seek in the container\n");
+        free(bytes);
+        free(index);
+        return 1;
+    }
+
+    int status = 0;
+    uint64_t data_length = header.index_offset - CONTAINER_HEADER_SIZE;
+    for (uint64_t chunk = 0; chunk < header.chunk_count && status == 0; chunk += chunks_per_read) {
+        uint64_t first = chunk * header.chunk_size;
+        size_t length = data_length - first < read_size ? data_length - first : read_size;
+        STATS_START(reading);
+        char short_read = fread(bytes, 1, length, input) != length;
+        STATS_STOP(reading, PHASE_READ, length);
+        if (short_read) {
+            fprintf(stderr, "Error: the container is cut short\n");
+            status = 1;
+            break;
+        }
+
+        // Every read starts on a chunk boundary, so its chain value comes straight from the index
+        stream.chain = des_load_block(&index[chunk * CONTAINER_INDEX_ENTRY + 8]);
+        if (crypt_buffer(&stream, bytes, bytes, length, 1) != 0) {
+            status = 1;
+            break;
+        }
+
+        // Leave the padding out, it is checked against the header on the way
+        size_t plain = header.plain_length - first < length ? header.plain_length - first : length;
+        if (plain < length && padding_length(des_load_block(&bytes[length - 8])) != header.padding)
+            fprintf(stderr, "Warning: the padding does not match the container header\n");
+        STATS_START(writing);
+        if (fwrite(bytes, 1, plain, output) != plain) {
+            perror("Error writing to file");
+            status = 1;
+        }
+        STATS_STOP(writing, PHASE_WRITE, plain);
+    }
+
+    free(bytes);
+    free(index);
+    return status;
+}
+
+static int check_container_header(const container_header *header, const des_ctx *cipher) {
+    // Check everything the offsets are computed from before trusting any of it
+    uint64_t data_length = header->index_offset - CONTAINER_HEADER_SIZE;
+    if (header->version != CONTAINER_VERSION || header->mode > DES_MODE_CTR || header->chunk_size == 0 ||
+        header->chunk_size % 8 != 0 || header->index_offset < CONTAINER_HEADER_SIZE || data_length % 8 != 0 ||
+        header->padding < 1 || header->padding > 8 || header->plain_length + header->padding != data_length ||
+        header->chunk_count != (data_length + header->chunk_size - 1) / header->chunk_size) {
+        fprintf(stderr, "Error: damaged or unsupported DES container\n");
+        return 1;
+    }
+    if (header->rounds != cipher->rounds) {
+        fprintf(stderr, "Error: the container was encrypted with %s, the key file holds a %s key\n",
+                        header->rounds == 48 ? "3DES" : "DES", cipher->rounds == 48 ? "3DES" : "DES");
+        return 1;
+    }
+    if (header->key_check != key_check_value(cipher, header->salt)) {
+        fprintf(stderr, "Error: wrong key for this container\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int open_range_reader(const char *input_name, const des_ctx *cipher, range_reader *reader,
+                             container_header *header) {
+    memset(reader, 0, sizeof(*reader));
+    reader->input = fopen(input_name, "rb");
+    struct stat info;
+    if (reader->input == NULL || fstat(fileno(reader->input), &info) != 0) {
+        perror("Error opening input file");
+        if (reader->input != NULL)
+            fclose(reader->input);
+        return 1;
+    }
+
+    // Containers: block i is at CONTAINER_HEADER_SIZE + 8 * i
+    uint8_t page[4096];
+    size_t length = fread(page, 1, sizeof(page), reader->input);
+    if (length >= CONTAINER_HEADER_SIZE && decode_container_header(page, header) == 0) {
+        if (check_container_header(header, cipher) != 0) {
+            fclose(reader->input);
+            return 1;
+        }
+        reader->format = RANGE_CONTAINER;
+        reader->size_in_blocks = (header->index_offset - CONTAINER_HEADER_SIZE) / 8;
+        return 0;
+    }
+
+    // Hex as we write it has no separators, so block i is at character 16 * i. That only holds if the file is
+    // nothing but whole blocks of digits and then at most whitespace (a final newline). Sampling is not enough,
+    // long lines can hide every separator from the first page, so the whole file is checked once: its mapping is
+    // counted on the worker threads, and only ranges with something else in them are looked at byte by byte. A
+    // hex range therefore costs a pass over the file, only containers are read in O(range).
+    size_t size = info.st_size;
+    const uint8_t *text = S_ISREG(info.st_mode) && size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+                                                                   fileno(reader->input), 0) : MAP_FAILED;
+    size_t ranges = (size + HEX_RANGE_SIZE - 1) / HEX_RANGE_SIZE;
+    uint64_t *counts = text != MAP_FAILED ? malloc((ranges + 1) * sizeof(uint64_t)) : NULL;
+    char dense = size == 0, trailing = 0;
+    uint64_t digits = 0;
+    if (counts != NULL) {
+        hex_split_job job = {.text = (const char *)text, .length = size, .digits = counts};
+        parallel_for(ranges, count_hex_task, &job);
+        dense = 1;
+        for (size_t r = 0; r < ranges && dense; r++) {
+            size_t start = r * HEX_RANGE_SIZE, span = size - start < HEX_RANGE_SIZE ? size - start : HEX_RANGE_SIZE;
+            if (!trailing && counts[r + 1] == span) {
+                digits += span;
+                continue;
+            }
+            for (size_t i = start; i < start + span && dense; i++) {
+                char digit = hex_digit_values[text[i]] != 0;
+                dense = digit ? !trailing : isspace(text[i]) != 0;
+                trailing |= !digit;
+                digits += digit;
+            }
+        }
+        free(counts);
+    }
+    if (text != MAP_FAILED)
+        munmap((void *)text, size);
+    if (digits % 16 != 0)
+        dense = 0;
+
+    reader->format = dense ? RANGE_DENSE_HEX : RANGE_SCANNED_HEX;
+    reader->size_in_blocks = dense ? digits / 16 : UINT64_MAX;
+    if (fseeko(reader->input, 0, SEEK_SET) != 0) {
+        perror("Error reading input file");
+        fclose(reader->input);
+        return 1;
+    }
+    return 0;
+}
+
+static int read_range_blocks(range_reader *reader, uint64_t first, size_t count, uint64_t *blocks, char *text,
+                             size_t *got) {
+    *got = 0;
+    if (first >= reader->size_in_blocks)
+        return 0;
+    if (count > reader->size_in_blocks - first)
+        count = reader->size_in_blocks - first;
+
+    if (reader->format == RANGE_CONTAINER) {
+        // The text buffer doubles as the byte buffer
+        uint8_t *bytes = (uint8_t *)text;
+        if (fseeko(reader->input, CONTAINER_HEADER_SIZE + first * 8, SEEK_SET) != 0 ||
+            fread(bytes, 8, count, reader->input) != count) {
+            fprintf(stderr, "Error: the container is cut short\n");
+            return 1;
+        }
+        for (size_t i = 0; i < count; i++)
+            blocks[i] = des_load_block(&bytes[i * 8]);
+        *got = count;
+        return 0;
+    }
+
+    if (reader->format == RANGE_DENSE_HEX) {
+        // Exactly 16 * count digits or the positions were wrong after all, the caller starts over with a scan (2)
+        hex_parser parser = {0, 0};
+        if (fseeko(reader->input, first * 16, SEEK_SET) != 0 || fread(text, 16, count, reader->input) != count ||
+            des_parse_hex(text, count * 16, &parser, blocks) != count)
+            return 2;
+        *got = count;
+        return 0;
+    }
+
+    // Scanned hex only goes forward, the blocks before first are parsed and dropped. Reading at most 16 characters
+    // per missing block never parses past the range, so the rest stays in the file for the next call.
+    while (*got < count) {
+        size_t length = fread(text, 1, (count - *got) * 16, reader->input);
+        if (ferror(reader->input)) {
+            perror("Error reading input file");
+            return 1;
+        }
+        if (length == 0)
+            break;
+
+        uint64_t *target = &blocks[*got];
+        uint64_t start = reader->parsed;
+        size_t parsed = des_parse_hex(text, length, &reader->parser, target);
+        reader->parsed += parsed;
+        if (reader->parsed <= first)
+            continue;
+        size_t skip = start < first ? first - start : 0;
+        memmove(target, &target[skip], (parsed - skip) * sizeof(uint64_t));
+        *got += parsed - skip;
+    }
+
+    // Look past any separators, so the caller knows when it has the last block (and its padding)
+    int ch;
+    while ((ch = getc(reader->input)) != EOF && hex_digit_values[ch] == 0)
+        ;
+    if (ch == EOF) {
+        reader->size_in_blocks = reader->parsed;
+        if (reader->parser.digits != 0)
+            fprintf(stderr,
+                    "Warning: ciphertext ends with %u hex digits that do not make a full block, ignoring them\n",
+                    reader->parser.digits);
+    } else {
+        ungetc(ch, reader->input);
+    }
+    return 0;
+}
+
+static int decrypt_range_blocks(range_reader *reader, des_ctx *cipher, FILE *output, uint64_t offset, uint64_t limit,
+                                uint64_t plain_length) {
+    // Blocks [first, end) cover the plaintext bytes [offset, limit)
+    uint64_t first = offset / 8;
+    uint64_t end = limit / 8 + (limit % 8 != 0);
+    size_t piece = (size_t)CHUNK_SIZE / 8 * pool.threads;
+    uint64_t *blocks = malloc(piece * sizeof(uint64_t));
+    char *text = malloc(piece * 16);
+    uint8_t *bytes = malloc(piece * 8);
+    if (blocks == NULL || text == NULL || bytes == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(blocks);
+        free(text);
+        free(bytes);
+        return 1;
+    }
+
+    // Chain value of the first block: CTR counts it, CBC takes the ciphertext block in front of it
+    size_t got;
+    int status = 0;
+    cipher->chain = cipher->iv;
+    if (cipher->mode == DES_MODE_CTR) {
+        cipher->chain = cipher->iv + first;
+    } else if (cipher->mode == DES_MODE_CBC && first > 0) {
+        status = read_range_blocks(reader, first - 1, 1, blocks, text, &got);
+        if (got == 1)
+            cipher->chain = blocks[0];
+    }
+
+    uint64_t block = first;
+    while (status == 0 && block < end) {
+        size_t count = end - block < piece ? end - block : piece;
+        status = read_range_blocks(reader, block, count, blocks, text, &got);
+        if (status != 0 || got == 0)
+            break;
+
+        for (size_t i = 0; i < got; i++)
+            des_store_block(blocks[i], &bytes[i * 8]);
+        if (crypt_buffer(cipher, bytes, bytes, got * 8, 1) != 0) {
+            status = 1;
+            break;
+        }
+
+        // The last block of the file carries the padding, hex only knows the plaintext length once it is there
+        if (plain_length == UINT64_MAX && block + got == reader->size_in_blocks) {
+            int padding = padding_length(des_load_block(&bytes[(got - 1) * 8]));
+            if (padding < 0) {
+                fprintf(stderr, "Warning: invalid padding in the last block, writing it unchanged\n");
+                padding = 0;
+            }
+            plain_length = reader->size_in_blocks * 8 - padding;
+        }
+
+        // Write the part of these blocks inside both the range and the plaintext
+        uint64_t from = block * 8 > offset ? block * 8 : offset;
+        uint64_t to = (block + got) * 8;
+        if (to > limit)
+            to = limit;
+        if (to > plain_length)
+            to = plain_length;
+        if (to > from && fwrite(&bytes[from - block * 8], 1, to - from, output) != to - from) {
+            perror("Error writing to file");
+            status = 1;
+        }
+        block += got;
+    }
+
+    if (status == 0 && limit != UINT64_MAX && (block < end || limit > plain_length))
+        fprintf(stderr, "Warning: the range goes past the end of the plaintext, it was cut short\n");
+
+    free(blocks);
+    free(text);
+    free(bytes);
+    return status;
+}
+
+static int decrypt_range(des_ctx *cipher, const char *input_name, const char *output_name, uint64_t offset,
+                         uint64_t length) {
+    range_reader reader;
+    container_header header;
+    if (open_range_reader(input_name, cipher, &reader, &header) != 0)
+        return 1;
+    FILE *output = fopen(output_name, "wb");
+    if (output == NULL) {
+        perror("Error opening output file");
+        fclose(reader.input);
+        return 1;
+    }
+
+    // Containers bring their own mode and IV, and know the plaintext length up front
+    des_ctx range = *cipher;
+    uint64_t plain_length = UINT64_MAX;
+    if (reader.format == RANGE_CONTAINER) {
+        range.mode = header.mode;
+        range.iv = header.iv;
+        plain_length = header.plain_length;
+    }
+
+    uint64_t limit = length > UINT64_MAX - offset ? UINT64_MAX : offset + length;
+    int status = decrypt_range_blocks(&reader, &range, output, offset, limit, plain_length);
+    if (status == 2) {
+        // Separators after all: start over and parse the hex from the front
+        reader.format = RANGE_SCANNED_HEX;
+        reader.size_in_blocks = UINT64_MAX;
+        rewind(reader.input);
+        if (fflush(output) != 0 || ftruncate(fileno(output), 0) != 0 || fseeko(output, 0, SEEK_SET) != 0) {
+            perror("Error writing to file");
+            status = 1;
+        } else {
+            status = decrypt_range_blocks(&reader, &range, output, offset, limit, plain_length);
+        }
+    }
+
+    fclose(reader.input);
+    if (fclose(output) != 0 && status == 0) {
+        perror("Error writing to file");
+        status = 1;
+    }
+    return status;
+}
+
+static int list_batch_files(const char *input, const char *output_dir, batch_file **files, size_t *file_count) {
+    *files = NULL;
+    *file_count = 0;
+    struct stat info, output_info;
+    if (stat(input, &info) != 0) {
+        perror(input);
+        return 1;
+    }
+    if ((mkdir(output_dir, 0777) != 0 && errno != EEXIST) || stat(output_dir, &output_info) != 0 ||
+        !S_ISDIR(output_info.st_mode)) {
+        fprintf(stderr, "Error: cannot use %s as the output directory\n", output_dir);
+        return 1;
+    }
+
+    int status = 0;
+    if (S_ISDIR(info.st_mode)) {
+        // Writing into the input directory would overwrite every input with its output
+        if (info.st_dev == output_info.st_dev && info.st_ino == output_info.st_ino) {
+            fprintf(stderr, "Error: the output directory must not be the input directory\n");
+            return 1;
+        }
+        DIR *directory = opendir(input);
+        if (directory == NULL) {
+            perror(input);
+            return 1;
+        }
+        struct dirent *entry;
+        while (status == 0 && (entry = readdir(directory)) != NULL) {
+            char *path = join_path(input, entry->d_name);
+            struct stat entry_info;
+            if (path == NULL)
+                status = 1;
+            else if (stat(path, &entry_info) == 0 && S_ISREG(entry_info.st_mode))
+                status = add_batch_file(files, file_count, path, output_dir, NULL);
+            free(path);
+        }
+        closedir(directory);
+    } else {
+        FILE *manifest = fopen(input, "r");
+        if (manifest == NULL) {
+            perror(input);
+            return 1;
+        }
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t length;
+        while (status == 0 && (length = getline(&line, &capacity, manifest)) != -1) {
+            // Empty lines and # comments are skipped, a tab separates the output file
+            while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+                line[--length] = '\0';
+            if (length == 0 || line[0] == '#')
+                continue;
+            char *output = strchr(line, '\t');
+            if (output != NULL)
+                *output++ = '\0';
+            status = add_batch_file(files, file_count, line, output_dir, output);
+        }
+        free(line);
+        fclose(manifest);
+    }
+
+    if (status != 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        free_batch_files(*files, *file_count);
+        *files = NULL;
+        *file_count = 0;
+        return status;
+    }
+
+    // Inputs with the same name in different directories (or listed twice) would write the same output file,
+    // sorting by output puts them next to each other so they can be failed instead
+    if (*file_count > 1)
+        qsort(*files, *file_count, sizeof(batch_file), compare_batch_outputs);
+    for (size_t i = 1; i < *file_count; i++)
+        if (strcmp((*files)[i - 1].output, (*files)[i].output) == 0)
+            (*files)[i - 1].collides = (*files)[i].collides = 1;
+    return 0;
+}
+
+static int add_batch_file(batch_file **files, size_t *file_count, const char *input, const char *output_dir,
+                          const char *output) {
+    // The array doubles whenever the count reaches a power of two
+    if ((*file_count & (*file_count - 1)) == 0) {
+        batch_file *grown = realloc(*files, (*file_count == 0 ? 1 : 2 * *file_count) * sizeof(batch_file));
+        if (grown == NULL)
+            return 1;
+        *files = grown;
+    }
+
+    const char *name = strrchr(input, '/');
+    batch_file *file = &(*files)[*file_count];
+    file->input = strdup(input);
+    file->collides = 0;
+    file->output = output != NULL ? strdup(output) : join_path(output_dir, name != NULL ? name + 1 : input);
+    if (file->input == NULL || file->output == NULL) {
+        free(file->input);
+        free(file->output);
+        return 1;
+    }
+    (*file_count)++;
+    return 0;
+}
+
+static void free_batch_files(batch_file *files, size_t file_count) {
+    for (size_t i = 0; i < file_count; i++) {
+        free(files[i].input);
+        free(files[i].output);
+    }
+    free(files);
+}
+
+static int compare_batch_outputs(const void *a, const void *b) {
+    return strcmp(((const batch_file *)a)->output, ((const batch_file *)b)->output);
+}
+
+static char *join_path(const char *directory, const char *name) {
+    size_t length = strlen(directory) + strlen(name) + 2;
+    char *path = malloc(length);
+    if (path != NULL)
+        snprintf(path, length, "%s/%s", directory, name);
+    return path;
+}
+
+static int crypt_batch_file(batch_job *job, const batch_file *file, batch_arena *arena) {
+    if (strcmp(file->input, file->output) == 0) {
+        fprintf(stderr, "Error: %s would overwrite itself\n", file->input);
+        return 1;
+    }
+    if (file->collides) {
+        fprintf(stderr, "Error: %s is not processed, another input also writes %s\n", file->input, file->output);
+        return 1;
+    }
+    int input = open(file->input, O_RDONLY);
+    if (input == -1) {
+        fprintf(stderr, "Error: %s: %s\n", file->input, strerror(errno));
+        return 1;
+    }
+    int output = open(file->output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (output == -1) {
+        fprintf(stderr, "Error: %s: %s\n", file->output, strerror(errno));
+        close(input);
+        return 1;
+    }
+
+    // Every file starts a new message from the IV, with the arena's buffers
+    des_ctx cipher = *job->cipher;
+    stream_stage *stage = &arena->stage;
+    stage->cipher = &cipher;
+    stage->chain = cipher.iv;
+    stage->parser = (hex_parser){0, 0};
+    stage->holding = 0;
+    stage->serial = 1;
+
+    int status = 0;
+    uint64_t input_bytes = 0, output_bytes = 0;
+    for (;;) {
+        // Fill a whole chunk, a short one is the end of the file
+        STATS_START(reading);
+        size_t length = 0;
+        while (length < job->chunk_size) {
+            ssize_t count = read(input, &arena->input[length], job->chunk_size - length);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count < 0) {
+                fprintf(stderr, "Error: %s: %s\n", file->input, strerror(errno));
+                status = 1;
+            }
+            if (count <= 0)
+                break;
+            length += count;
+        }
+        STATS_STOP(reading, PHASE_READ, length);
+        if (status != 0)
+            break;
+
+        char last = length < job->chunk_size;
+        size_t produced = job->decrypting ? decrypt_hex_stage(stage, arena->input, length, last, arena->output)
+                                          : encrypt_hex_stage(stage, arena->input, length, last, arena->output);
+        STATS_START(writing);
+        for (size_t written = 0; written < produced && status == 0;) {
+            ssize_t count = write(output, &arena->output[written], produced - written);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0) {
+                fprintf(stderr, "Error: %s: %s\n", file->output, strerror(errno));
+                status = 1;
+            }
+            written += count > 0 ? count : 0;
+        }
+        STATS_STOP(writing, PHASE_WRITE, produced);
+        input_bytes += length;
+        output_bytes += produced;
+        if (last || status != 0)
+            break;
+    }
+
+    close(input);
+    if (close(output) != 0 && status == 0) {
+        fprintf(stderr, "Error: %s: %s\n", file->output, strerror(errno));
+        status = 1;
+    }
+    atomic_fetch_add(&job->input_bytes, input_bytes);
+    atomic_fetch_add(&job->output_bytes, output_bytes);
+    return status;
+}
+
+static void batch_task(void *context, uint64_t index) {
+    batch_job *job = context;
+    batch_arena *arena = &job->arenas[pool_self];
+
+    // The first file on a thread sets up its arena, the others reuse it
+    if (arena->input == NULL) {
+        arena->input = malloc(job->chunk_size + 8);
+        arena->output = malloc(job->decrypting ? job->chunk_size / 2 + 16 : 2 * job->chunk_size + 16);
+        if (arena->input == NULL || arena->output == NULL ||
+            init_stream_stage(&arena->stage, job->cipher, job->chunk_size, job->decrypting) != 0) {
+            fprintf(stderr, "Error: out of memory\n");
+            free(arena->input);
+            free(arena->output);
+            arena->input = NULL;
+            arena->output = NULL;
+            atomic_fetch_add(&job->failed, 1);
+            return;
+        }
+    }
+
+    if (crypt_batch_file(job, &job->files[index], arena) == 0)
+        atomic_fetch_add(&job->done, 1);
+    else
+        atomic_fetch_add(&job->failed, 1);
+}
+
+static int crypt_batch(des_ctx *cipher, const char *input, const char *output_dir, char decrypting,
+                       des_batch_stats *stats) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    batch_file *files;
+    size_t file_count;
+    if (list_batch_files(input, output_dir, &files, &file_count) != 0)
+        return 1;
+
+    // Chunks are per file here, not per thread: every thread works on a file of its own
+    batch_job job = {.cipher = cipher, .decrypting = decrypting, .files = files,
+                     .chunk_size = pipeline.chunk_size != 0 ? pipeline.chunk_size : CHUNK_SIZE,
+                     .arenas = calloc(pool.threads, sizeof(batch_arena))};
+    if (job.arenas == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        free_batch_files(files, file_count);
+        return 1;
+    }
+    parallel_for(file_count, batch_task, &job);
+
+    for (unsigned int i = 0; i < pool.threads; i++) {
+        free_stream_stage(&job.arenas[i].stage);
+        free(job.arenas[i].input);
+        free(job.arenas[i].output);
+    }
+    free(job.arenas);
+    free_batch_files(files, file_count);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (stats != NULL) {
+        stats->files = job.done;
+        stats->failed = job.failed;
+        stats->input_bytes = job.input_bytes;
+        stats->output_bytes = job.output_bytes;
+        stats->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    }
+    return job.failed != 0;
+}
+
+static int encrypt_mapped(const char *input_name, const char *output_name, des_ctx *cipher) {
+    int input = open(input_name, O_RDONLY);
+    if (input == -1) {
+        perror("Error opening input file");
+        return 1;
+    }
+    struct stat info;
+    if (fstat(input, &info) != 0) {
+        perror("Error reading input file");
+        close(input);
+        return 1;
+    }
+    if (same_file(input, output_name)) {
+        fprintf(stderr, "Error: %s would overwrite itself, choose another output file\n", input_name);
+        close(input);
+        return 1;
+    }
+
+    // The ciphertext size is known up front: PKCS#5 always adds 1 to 8 bytes, and every block is 16 hex digits
+    size_t length = info.st_size;
+    size_t size_in_blocks = length / 8 + 1;
+    size_t output_length = size_in_blocks * 16;
+
+    int output = open(output_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (output == -1 || ftruncate(output, output_length) != 0) {
+        perror("Error opening output file");
+        close(input);
+        if (output != -1)
+            close(output);
+        return 1;
+    }
+
+    size_t chunk_blocks = (size_t)CHUNK_SIZE / 8 * pool.threads;
+    const uint8_t *bytes = length == 0 ? NULL : mmap(NULL, length, PROT_READ, MAP_PRIVATE, input, 0);
+    char *text = mmap(NULL, output_length, PROT_READ | PROT_WRITE, MAP_SHARED, output, 0);
+    uint64_t *blocks = malloc(chunk_blocks * sizeof(uint64_t));
+    int status = 0;
+
+    if (bytes == MAP_FAILED || text == MAP_FAILED || blocks == NULL) {
+        perror("Error mapping files");
+        status = 1;
+    } else {
+        if (bytes != NULL)
+            madvise((void *)bytes, length, MADV_SEQUENTIAL);
+
+        // Load big-endian words straight from the mapping and hex encode straight into the output mapping
+        uint64_t chain = cipher->iv;
+        for (size_t first = 0; first < size_in_blocks; first += chunk_blocks) {
+            size_t count = size_in_blocks - first < chunk_blocks ? size_in_blocks - first : chunk_blocks;
+            size_t whole = length / 8 - first < count ? length / 8 - first : count;
+
+            // The last block is the only partial one, pad it here
+            if (whole < count) {
+                uint8_t tail[8];
+                unsigned char leftover = length % 8;
+                if (leftover != 0)
+                    memcpy(tail, &bytes[length - leftover], leftover);
+                memset(&tail[leftover], 8 - leftover, 8 - leftover);
+                blocks[whole] = des_load_block(tail);
+            }
+
+            chunk_job job = {.cipher = cipher, .decrypting = 0, .blocks = blocks, .size_in_blocks = count,
+                             .input_bytes = bytes == NULL ? NULL : &bytes[first * 8], .input_blocks = whole,
+                             .chain = chain, .output_text = &text[first * 16]};
+            chain = run_chunk(&job);
+        }
+    }
+
+    if (bytes != NULL && bytes != MAP_FAILED)
+        munmap((void *)bytes, length);
+    if (text != MAP_FAILED)
+        munmap(text, output_length);
+    free(blocks);
+    close(input);
+    if (close(output) != 0 && status == 0) {
+        perror("Error writing to file");
+        status = 1;
+    }
+    return status;
+}
+
+static int decrypt_mapped(const char *input_name, const char *output_name, des_ctx *cipher) {
+    int input = open(input_name, O_RDONLY);
+    if (input == -1) {
+        perror("Error opening input file");
+        return 1;
+    }
+    struct stat info;
+    if (fstat(input, &info) != 0) {
+        perror("Error reading input file");
+        close(input);
+        return 1;
+    }
+    if (same_file(input, output_name)) {
+        fprintf(stderr, "Error: %s would overwrite itself, choose another output file\n", input_name);
+        close(input);
+        return 1;
+    }
+
+    // Every 16 hex digits make 8 bytes, so half the input size is an upper bound for the output
+    size_t length = info.st_size;
+    size_t output_length = length / 16 * 8;
+
+    int output = open(output_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (output == -1 || ftruncate(output, output_length) != 0) {
+        perror("Error opening output file");
+        close(input);
+        if (output != -1)
+            close(output);
+        return 1;
+    }
+
+    size_t chunk_size = (size_t)CHUNK_SIZE * pool.threads;
+    const char *text = length == 0 ? NULL : mmap(NULL, length, PROT_READ, MAP_PRIVATE, input, 0);
+    uint64_t *blocks = output_length == 0 ? NULL :
+                       mmap(NULL, output_length, PROT_READ | PROT_WRITE, MAP_SHARED, output, 0);
+    // CBC needs the ciphertext of the previous block after it has been decrypted, so it parses into a side buffer
+    uint64_t *cipher_text = cipher->mode == DES_MODE_CBC ? malloc(chunk_size / 16 * sizeof(uint64_t)) : NULL;
+    hex_parser parser = {0, 0};
+    size_t size_in_blocks = 0;
+    int status = 0;
+
+    if (text == MAP_FAILED || blocks == MAP_FAILED || (cipher->mode == DES_MODE_CBC && cipher_text == NULL)) {
+        perror("Error mapping files");
+        status = 1;
+    } else {
+        if (text != NULL)
+            madvise((void *)text, length, MADV_SEQUENTIAL);
+
+        // Parse into the output mapping, decrypt there in place, then store big-endian in place
+        uint64_t chain = cipher->iv;
+        for (size_t first = 0; first < length; first += chunk_size) {
+            uint64_t *target = &blocks[size_in_blocks];
+            uint64_t *parsed = cipher_text != NULL ? cipher_text : target;
+            size_t count = des_parse_hex_parallel(&text[first],
+                                                  length - first < chunk_size ? length - first : chunk_size,
+                                                  &parser, parsed);
+            chunk_job job = {.cipher = cipher, .decrypting = 1, .blocks = target, .size_in_blocks = count,
+                             .source = parsed, .chain = chain, .output_bytes = (uint8_t *)target};
+            chain = run_chunk(&job);
+            size_in_blocks += count;
+        }
+
+        if (parser.digits != 0)
+            fprintf(stderr,
+                    "Warning: ciphertext ends with %u hex digits that do not make a full block, ignoring them\n",
+                    parser.digits);
+    }
+
+    // Strip the PKCS#5 padding from the final block and cut the file to its real size
+    size_t plain_length = size_in_blocks * 8;
+    if (status == 0 && size_in_blocks != 0) {
+        int padding = padding_length(des_load_block((uint8_t *)&blocks[size_in_blocks - 1]));
+        if (padding < 0) {
+            fprintf(stderr, "Warning: invalid padding in the last block, writing it unchanged\n");
+            padding = 0;
+        }
+        plain_length -= padding;
+    }
+
+    if (text != NULL && text != MAP_FAILED)
+        munmap((void *)text, length);
+    if (blocks != NULL && blocks != MAP_FAILED)
+        munmap(blocks, output_length);
+    free(cipher_text);
+    if (status == 0 && ftruncate(output, plain_length) != 0) {
+        perror("Error writing to file");
+        status = 1;
+    }
+    close(input);
+    if (close(output) != 0 && status == 0) {
+        perror("Error writing to file");
+        status = 1;
+    }
+    return status;
+}
+
+void des_encode_daemon_request(const daemon_request *request, uint8_t bytes[DAEMON_REQUEST_HEADER]) {
+    uint32_t length = htobe32(request->length), key_id = htobe32(request->key_id);
+    uint32_t request_id = htobe32(request->request_id);
+
+    memset(bytes, 0, DAEMON_REQUEST_HEADER);
+    memcpy(bytes, &length, 4);
+    bytes[4] = request->op;
+    bytes[5] = request->mode;
+    memcpy(&bytes[8], &key_id, 4);
+    memcpy(&bytes[12], &request_id, 4);
+    des_store_block(request->iv, &bytes[16]);
+}
+
+void des_decode_daemon_request(const uint8_t bytes[DAEMON_REQUEST_HEADER], daemon_request *request) {
+    uint32_t length, key_id, request_id;
+    memcpy(&length, bytes, 4);
+    memcpy(&key_id, &bytes[8], 4);
+    memcpy(&request_id, &bytes[12], 4);
+    request->length = be32toh(length);
+    request->op = bytes[4];
+    request->mode = bytes[5];
+    request->key_id = be32toh(key_id);
+    request->request_id = be32toh(request_id);
+    request->iv = des_load_block(&bytes[16]);
+}
+
+void des_encode_daemon_response(const daemon_response *response, uint8_t bytes[DAEMON_RESPONSE_HEADER]) {
+    uint32_t length = htobe32(response->length), request_id = htobe32(response->request_id);
+
+    memset(bytes, 0, DAEMON_RESPONSE_HEADER);
+    memcpy(bytes, &length, 4);
+    bytes[4] = response->status;
+    memcpy(&bytes[8], &request_id, 4);
+}
+
+void des_decode_daemon_response(const uint8_t bytes[DAEMON_RESPONSE_HEADER], daemon_response *response) {
+    uint32_t length, request_id;
+    memcpy(&length, bytes, 4);
+    memcpy(&request_id, &bytes[8], 4);
+    response->length = be32toh(length);
+    response->status = bytes[4];
+    response->request_id = be32toh(request_id);
+}
+
+
+
+void des_initial_permutation(uint64_t input, uint64_t *output) {
+    *output = 0;
+    LOOP(i, 64) {
+        // Set the i-th bit of the output to the (64 - table[i])th bit of the input
+        SET_BIT(output, input, i, initial_permutation_table, 64, 64 - 1);
+    }
+}
+
+static void inverse_initial_permutation(uint64_t input, uint64_t *output) {
+    *output = 0;
+    LOOP(i, 64) {
+        // Set the i-th bit of the output to the (64 - table[i])th bit of the input
+        SET_BIT(output, input, i, Final_permutation, 64, 64 - 1);
+    }
+}
+
+static void expansion_d_box(uint64_t input, uint64_t *output) {
+    *output = 0;
+    LOOP(i, 48) {
+        // Set the i-th bit of the output to the (64 - table[i])th bit of the input
+        SET_BIT(output, input, i, expansion_d_box_table, 32, 48 - 1);
+    }
+}
+
+static void straight_permutation(uint64_t input, uint64_t *output) {
+    *output = 0;
+    LOOP(i, 32) {
+        // Set the i-th bit of the output to the (64 - table[i])th bit of the input
+        SET_BIT(output, input, i, straight_permutation_table, 32, 32 - 1);
+    }
+}
+
+static void permuted_choice_1(uint64_t key, uint64_t *c, uint64_t *d) {
+    *c = 0;
+    *d = 0;
+
+    LOOP(i, 28) {
+        SET_BIT(c, key, i, permuted_choice_1_table, 64, 28 - 1);
+    }
+
+    LOOP(i, 28) {
+        (*d) |= (((key) >> (64 - permuted_choice_1_table[i + 28])) & 1) << (27 - i);
+    }
+}
+
+static void permuted_choice_2(uint64_t c, uint64_t d, uint64_t *key) {
+    *key = 0;
+    uint64_t temp = (c << 28) | d;
+    LOOP(i, 48) {
+        // Set the i-th bit of the output to the (56 - table[i])th bit of the input
+        SET_BIT(key, temp, i, permuted_choice_2_table, 56, 48 - 1);
+    }
+}
+
+static uint64_t byte_permute(uint64_t input, const uint64_t table[][256], unsigned char bytes) {
+    uint64_t output = 0;
+    LOOP(j, bytes) {
+        // OR in the contribution of the j-th byte (from the top) of the input
+        output |= table[j][(input >> ((bytes - 1 - j) * 8)) & 0xFF];
+    }
+    return output;
+}
+
+void des_initial_permutation_fast(uint64_t input, uint64_t *output) {
+    *output = byte_permute(input, initial_permutation_lookup, 8);
+}
+
+static void inverse_initial_permutation_fast(uint64_t input, uint64_t *output) {
+    *output = byte_permute(input, final_permutation_lookup, 8);
+}
+
+static void permuted_choice_1_fast(uint64_t key, uint64_t *c, uint64_t *d) {
+    uint64_t cd = byte_permute(key, permuted_choice_1_lookup, 8);
+    *c = cd >> 28;
+    *d = cd & 0xFFFFFFF;
+}
+
+static void permuted_choice_2_fast(uint64_t c, uint64_t d, uint64_t *key) {
+    *key = byte_permute((c << 28) | d, permuted_choice_2_lookup, 7);
+}
+
+static void left_shift(uint64_t *key, unsigned char round) {
+    unsigned char shift = left_shift_table[round];
+
+    // Perform a left shift by 'shift' bits
+    *key = ((*key << shift) & 0xFFFFFFF) | (*key >> (28 - shift));
+}
+
+void des_generate_keys(uint64_t key, uint64_t keys[16]) {
+    uint64_t c, d;
+    permuted_choice_1_fast(key, &c, &d);
+
+    LOOP(i, 16) {
+        left_shift(&c, i);
+        left_shift(&d, i);
+        permuted_choice_2_fast(c, d, &keys[i]);
+    }
+}
+
+void des_generate_keys_reference(uint64_t key, uint64_t keys[16]) {
+    uint64_t c, d;
+    permuted_choice_1(key, &c, &d);
+
+    LOOP(i, 16) {
+        left_shift(&c, i);
+        left_shift(&d, i);
+        permuted_choice_2(c, d, &keys[i]);
+    }
+}
+
+static void generate_schedule(const uint64_t *des_keys, unsigned int key_count, uint64_t keys[48],
+                              unsigned char *rounds) {
+    des_generate_keys(des_keys[0], keys);
+    if (key_count < 2) {
+        *rounds = 16;
+        return;
+    }
+
+    // 3DES EDE runs the K2 schedule backwards in the middle, EDE2 reuses K1 as K3
+    uint64_t middle[16];
+    des_generate_keys(des_keys[1], middle);
+    LOOP(i, 16) {
+        keys[16 + i] = middle[15 - i];
+    }
+    des_generate_keys(des_keys[key_count < 3 ? 0 : 2], &keys[32]);
+    *rounds = 48;
+}
+
+static void xor(uint64_t a, uint64_t b, uint64_t *result) {
+    *result = a ^ b;
+}
+
+static void swap(uint64_t *a, uint64_t *b) {
+    uint64_t temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+void des_s_box(uint64_t input, uint64_t *output) {
+    *output = 0;
+    LOOP(i, 8) {
+        // Get the 6-bit block from the input
+        uint64_t block = (input >> (48 - (i + 1) * 6)) & 0x3F;
+
+        // Get the row and column from the block
+        unsigned char row = ((block & 0x20) >> 4) | (block & 1);
+        unsigned char col = (block >> 1) & 0xF;
+
+        // Get the value from the S-box
+        uint64_t value = s_box_table[i][row][col];
+
+        // Set the 4-bit value to the output
+        *output |= value << (32 - (i + 1) * 4);
+    }
+}
+
+void des_f_function(uint64_t right, uint64_t key, uint64_t *output) {
+    uint64_t expanded_right;
+    expansion_d_box(right, &expanded_right);
+
+    uint64_t xored;
+    xor(expanded_right, key, &xored);
+
+    uint64_t s_box_output;
+    des_s_box(xored, &s_box_output);
+
+    straight_permutation(s_box_output, output);
+}
+
+void des_f_function_fast(uint64_t right, uint64_t key, uint64_t *output) {
+    uint32_t r = (uint32_t)right;
+    uint32_t result = 0;
+    LOOP(i, 8) {
+        // The i-th 6-bit group of E(R) is bits 4i..4i+5 (1-indexed, wrapping), rotate them down to bit 0
+        uint32_t expanded = ROTL32(r, 4 * i + 5) & 0x3F;
+        uint32_t sub_key = (uint32_t)(key >> (48 - (i + 1) * 6)) & 0x3F;
+        result |= sp_box_table[i][expanded ^ sub_key];
+    }
+    *output = result;
+}
+
+void des_encrypt_block(uint64_t plain_text, uint64_t keys[16], uint64_t *cipher_text) {
+    uint64_t ip;
+    des_initial_permutation_fast(plain_text, &ip);
+
+    uint64_t l = (ip >> 32) & 0xFFFFFFFF;
+    uint64_t r = ip & 0xFFFFFFFF;
+
+    LOOP(i, 16) {
+        uint64_t temp = r;
+        uint64_t f_output;
+        des_f_function_fast(r, keys[i], &f_output);
+
+        xor(l, f_output, &r);
+        l = temp;
+    }
+
+    swap(&l, &r);
+
+    *cipher_text = (l << 32) | r;
+    inverse_initial_permutation_fast(*cipher_text, cipher_text);
+}
+
+void des_decrypt_block(uint64_t cipher_text, uint64_t keys[16], uint64_t *plain_text) {
+    uint64_t ip;
+    des_initial_permutation_fast(cipher_text, &ip);
+
+    uint64_t l = (ip >> 32) & 0xFFFFFFFF;
+    uint64_t r = ip & 0xFFFFFFFF;
+
+    LOOP(i, 16) {
+        uint64_t temp = r;
+        uint64_t f_output;
+        des_f_function_fast(r, keys[15 - i], &f_output);
+
+        xor(l, f_output, &r);
+        l = temp;
+    }
+
+    swap(&l, &r);
+
+    *plain_text = (l << 32) | r;
+    inverse_initial_permutation_fast(*plain_text, plain_text);
+}
+
+void des_crypt_block(uint64_t input, const uint64_t *keys, unsigned char rounds, char decrypting, uint64_t *output) {
+    uint64_t ip;
+    des_initial_permutation_fast(input, &ip);
+
+    uint64_t l = (ip >> 32) & 0xFFFFFFFF;
+    uint64_t r = ip & 0xFFFFFFFF;
+
+    // Decryption runs the whole schedule backwards, for 3DES that is D K3, E K2, D K1
+    LOOP(i, rounds) {
+        uint64_t temp = r;
+        uint64_t f_output;
+        des_f_function_fast(r, keys[decrypting ? rounds - 1 - i : i], &f_output);
+
+        xor(l, f_output, &r);
+        l = temp;
+
+        // FP and the IP of the next DES pass cancel out, only the swap that FP is preceded by remains
+        if (i % 16 == 15 && i + 1 < rounds)
+            swap(&l, &r);
+    }
+
+    swap(&l, &r);
+
+    *output = (l << 32) | r;
+    inverse_initial_permutation_fast(*output, output);
+}
+
+void des_encrypt_reference(uint64_t plain_text, uint64_t keys[16], uint64_t *cipher_text) {
+    uint64_t ip;
+    des_initial_permutation(plain_text, &ip);
+
+    uint64_t l = (ip >> 32) & 0xFFFFFFFF;
+    uint64_t r = ip & 0xFFFFFFFF;
+
+    LOOP(i, 16) {
+        uint64_t temp = r;
+        uint64_t f_output;
+        des_f_function(r, keys[i], &f_output);
+
+        xor(l, f_output, &r);
+        l = temp;
+    }
+
+    swap(&l, &r);
+
+    *cipher_text = (l << 32) | r;
+    inverse_initial_permutation(*cipher_text, cipher_text);
+}
+
+void des_decrypt_reference(uint64_t cipher_text, uint64_t keys[16], uint64_t *plain_text) {
+    uint64_t ip;
+    des_initial_permutation(cipher_text, &ip);
+
+    uint64_t l = (ip >> 32) & 0xFFFFFFFF;
+    uint64_t r = ip & 0xFFFFFFFF;
+
+    LOOP(i, 16) {
+        uint64_t temp = r;
+        uint64_t f_output;
+        des_f_function(r, keys[15 - i], &f_output);
+
+        xor(l, f_output, &r);
+        l = temp;
+    }
+
+    swap(&l, &r);
+
+    *plain_text = (l << 32) | r;
+    inverse_initial_permutation(*plain_text, plain_text);
+}
+
+static void transpose_64x64(uint64_t matrix[64]) {
+    // Swap the off-diagonal quadrants of ever smaller sub-matrices (bit 63 is column 0)
+    uint64_t mask = 0x00000000FFFFFFFF;
+    for (unsigned char width = 32; width != 0; width >>= 1, mask ^= mask << width) {
+        for (unsigned char k = 0; k < 64; k = ((k | width) + 1) & ~width) {
+            uint64_t temp = (matrix[k] ^ (matrix[k | width] >> width)) & mask;
+            matrix[k] ^= temp;
+            matrix[k | width] ^= temp << width;
+        }
+    }
+}
+
+// Scalar engine: 64 blocks per call in uint64_t planes
+#define BITSLICE_WORD uint64_t
+#define BITSLICE_LANES 1
+#define BITSLICE_NAME(x) x
+#define BITSLICE_TARGET
+#include "bitslice_engine.h"
+#undef BITSLICE_WORD
+#undef BITSLICE_LANES
+#undef BITSLICE_NAME
+#undef BITSLICE_TARGET
+
+#if defined(__x86_64__) || defined(__i386__)
+typedef uint64_t bitslice_word_128 __attribute__((vector_size(16)));
+typedef uint64_t bitslice_word_256 __attribute__((vector_size(32)));
+typedef uint64_t bitslice_word_512 __attribute__((vector_size(64)));
+
+// SSE2 engine: 128 blocks per call
+#define BITSLICE_WORD bitslice_word_128
+#define BITSLICE_LANES 2
+#define BITSLICE_NAME(x) x##_sse2
+#define BITSLICE_TARGET __attribute__((target("sse2")))
+#include "bitslice_engine.h"
+#undef BITSLICE_WORD
+#undef BITSLICE_LANES
+#undef BITSLICE_NAME
+#undef BITSLICE_TARGET
+
+// AVX2 engine: 256 blocks per call
+#define BITSLICE_WORD bitslice_word_256
+#define BITSLICE_LANES 4
+#define BITSLICE_NAME(x) x##_avx2
+#define BITSLICE_TARGET __attribute__((target("avx2")))
+#include "bitslice_engine.h"
+#undef BITSLICE_WORD
+#undef BITSLICE_LANES
+#undef BITSLICE_NAME
+#undef BITSLICE_TARGET
+
+// AVX-512 engine: 512 blocks per call
+#define BITSLICE_WORD bitslice_word_512
+#define BITSLICE_LANES 8
+#define BITSLICE_NAME(x) x##_avx512
+#define BITSLICE_TARGET __attribute__((target("avx512f")))
+#include "bitslice_engine.h"
+#undef BITSLICE_WORD
+#undef BITSLICE_LANES
+#undef BITSLICE_NAME
+#undef BITSLICE_TARGET
+
+// __builtin_cpu_supports reads cpuid (and checks the OS saves the wider registers)
+static int cpu_has_sse2(void) {
+    return __builtin_cpu_supports("sse2");
+}
+
+static int cpu_has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+static int cpu_has_avx512(void) {
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+static int always_supported(void) {
+    return 1;
+}
+
+static void table_crypt(const uint64_t *input, const uint64_t *keys, unsigned char rounds, char decrypting,
+                        uint64_t *output) {
+    des_crypt_block(*input, keys, rounds, decrypting, output);
+}
+
+// Engines from the widest to the narrowest, the table engine handles any tail and must stay last
+static const engine engines[] = {
+#if defined(__x86_64__) || defined(__i386__)
+        {"avx512", 512, cpu_has_avx512, bitslice_crypt_avx512, bitslice_crypt_lanes_avx512, bitslice_search_avx512},
+        {"avx2", 256, cpu_has_avx2, bitslice_crypt_avx2, bitslice_crypt_lanes_avx2, bitslice_search_avx2},
+        {"sse2", 128, cpu_has_sse2, bitslice_crypt_sse2, bitslice_crypt_lanes_sse2, bitslice_search_sse2},
+#endif
+        {"bitslice", 64, always_supported, bitslice_crypt, bitslice_crypt_lanes, bitslice_search},
+        {"table", 1, always_supported, table_crypt, NULL, NULL}
+};
+
+#define ENGINE_COUNT (sizeof(engines) / sizeof(engines[0]))
+#define MAX_ENGINE_BLOCKS 512
+
+static unsigned char engine_usable[ENGINE_COUNT];
+static const engine *selected_engine = &engines[ENGINE_COUNT - 1];
+
+int des_bitslice_leaves_self_test(void) {
+    // Regroup every S-box output bit by the top four input bits and compare with the table
+    LOOP(i, 8) {
+        LOOP(q, 4) {
+            LOOP(p, 16) {
+                unsigned char leaf = 0;
+                LOOP(m, 4) {
+                    unsigned char v = (p << 2) | m;
+                    unsigned char row = ((v & 0x20) >> 4) | (v & 1);
+                    unsigned char col = (v >> 1) & 0xF;
+                    leaf |= ((s_box_table[i][row][col] >> (3 - q)) & 1) << m;
+                }
+                if (bitslice_s_box_leaves[i][q][p] != leaf)
+                    return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int engine_self_test(const engine *e) {
+    // The bitsliced engines (the ones that can search) take their S-boxes from bitslice_s_box_leaves
+    if (e->search != NULL && !des_bitslice_leaves_self_test())
+        return 0;
+
+    uint64_t plain_text[MAX_ENGINE_BLOCKS], cipher_text[MAX_ENGINE_BLOCKS], decrypted[MAX_ENGINE_BLOCKS];
+    uint64_t des_keys[3] = {0x133457799BBCDFF1, 0x0E329232EA6D0D73, 0xA1B2C3D4E5F60718};
+    uint64_t keys[3][16], schedule[48];
+    unsigned char rounds;
+    LOOP(k, 3) {
+        des_generate_keys_reference(des_keys[k], keys[k]);
+    }
+    generate_schedule(des_keys, 3, schedule, &rounds);
+
+    // Block 0 is the textbook known answer, the others are checked against the reference implementation
+    for (unsigned int i = 0; i < e->blocks; i++)
+        plain_text[i] = 0x0123456789ABCDEF ^ (i * 0x9E3779B97F4A7C15);
+
+    e->crypt(plain_text, keys[0], 16, 0, cipher_text);
+    e->crypt(cipher_text, keys[0], 16, 1, decrypted);
+
+    if (cipher_text[0] != 0x85E813540F0AB405)
+        return 0;
+    for (unsigned int i = 0; i < e->blocks; i++) {
+        uint64_t expected;
+        des_encrypt_reference(plain_text[i], keys[0], &expected);
+        if (cipher_text[i] != expected || decrypted[i] != plain_text[i])
+            return 0;
+    }
+
+    // 3DES in one pass against three reference passes (E K1, D K2, E K3)
+    e->crypt(plain_text, schedule, rounds, 0, cipher_text);
+    e->crypt(cipher_text, schedule, rounds, 1, decrypted);
+
+    for (unsigned int i = 0; i < e->blocks; i++) {
+        uint64_t expected;
+        des_encrypt_reference(plain_text[i], keys[0], &expected);
+        des_decrypt_reference(expected, keys[1], &expected);
+        des_encrypt_reference(expected, keys[2], &expected);
+        if (cipher_text[i] != expected || decrypted[i] != plain_text[i])
+            return 0;
+    }
+    if (e->crypt_lanes == NULL)
+        return 1;
+
+    // 3DES with keys of their own for every block: the three keys rotated by the block number
+    uint64_t key_indices[3 * MAX_ENGINE_BLOCKS];
+    for (unsigned int i = 0; i < e->blocks; i++) {
+        LOOP(p, 3) {
+            key_indices[i * 3 + p] = des_key_index(des_keys[p]) ^ ((uint64_t)i << (p * 9));
+        }
+    }
+    e->crypt_lanes(plain_text, key_indices, 48, 0, cipher_text);
+    e->crypt_lanes(cipher_text, key_indices, 48, 1, decrypted);
+
+    for (unsigned int i = 0; i < e->blocks; i++) {
+        uint64_t expected = plain_text[i];
+        LOOP(p, 3) {
+            des_generate_keys_reference(des_key_from_index(key_indices[i * 3 + p]), keys[p]);
+            (p == 1 ? des_decrypt_reference : des_encrypt_reference)(expected, keys[p], &expected);
+        }
+        if (cipher_text[i] != expected || decrypted[i] != plain_text[i])
+            return 0;
+    }
+    return 1;
+}
+
+static void select_engine(void) {
+    // DES_ENGINE=<name> forces one engine (for benchmarking), otherwise the widest usable one wins
+    const char *forced = getenv("DES_ENGINE");
+    const engine *chosen = NULL;
+
+    LOOP(i, ENGINE_COUNT) {
+        engine_usable[i] = engines[i].supported() && engine_self_test(&engines[i]);
+        if (chosen == NULL && engine_usable[i] && (forced == NULL || strcmp(forced, engines[i].name) == 0))
+            chosen = &engines[i];
+    }
+
+    if (forced != NULL && chosen == NULL) {
+        fprintf(stderr, "Warning: engine '%s' is unknown or not usable here, using the fastest one\n", forced);
+        LOOP(i, ENGINE_COUNT) {
+            if (chosen == NULL && engine_usable[i])
+                chosen = &engines[i];
+        }
+    }
+    selected_engine = chosen != NULL ? chosen : &engines[ENGINE_COUNT - 1];
+}
+
+void des_crypt_blocks(const engine *widest, const uint64_t *input, const uint64_t *keys, unsigned char rounds,
+                      char decrypting, uint64_t *output, uint64_t size_in_blocks) {
+    uint64_t done = 0;
+
+    // Run the widest engine over as much as it can take, then hand the remainder to the narrower ones
+    for (const engine *e = widest; e < engines + ENGINE_COUNT; e++) {
+        if (!engine_usable[e - engines] && e != &engines[ENGINE_COUNT - 1])
+            continue;
+        for (; done + e->blocks <= size_in_blocks; done += e->blocks)
+            e->crypt(&input[done], keys, rounds, decrypting, &output[done]);
+    }
+}
+
+static size_t crypt_lanes(const engine *widest, const uint64_t *input, const uint64_t *key_indices,
+                          unsigned char rounds, char decrypting, uint64_t *output, size_t size_in_blocks) {
+    // Like des_crypt_blocks, but the tail below the narrowest bitsliced engine is left to the caller, which has the
+    // key schedules for it. Returns the blocks done.
+    size_t done = 0;
+    unsigned char passes = rounds / 16;
+    for (const engine *e = widest; e < engines + ENGINE_COUNT; e++) {
+        if (!engine_usable[e - engines] || e->crypt_lanes == NULL)
+            continue;
+        for (; done + e->blocks <= size_in_blocks; done += e->blocks)
+            e->crypt_lanes(&input[done], &key_indices[done * passes], rounds, decrypting, &output[done]);
+    }
+    return done;
+}
+
+// Hex codecs: the scalar one handles anything, the SIMD ones take the runs of whole blocks without separators
+FORCE_INLINE void parse_hex_char(char ch, hex_parser *parser, uint64_t *blocks, size_t *count) {
+    // Anything that is not a hex digit (newlines, spaces, ...) is skipped
+    unsigned char value = hex_digit_values[(unsigned char)ch];
+    if (value == 0)
+        return;
+
+    parser->block = (parser->block << 4) | (value - 1);
+    if (++parser->digits == 16) {
+        blocks[(*count)++] = parser->block;
+        parser->block = 0;
+        parser->digits = 0;
+    }
+}
+
+size_t des_parse_hex_scalar(const char *text, size_t length, hex_parser *parser, uint64_t *blocks) {
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++)
+        parse_hex_char(text[i], parser, blocks, &count);
+    return count;
+}
+
+void des_encode_hex_scalar(const uint64_t *blocks, size_t size_in_blocks, char *text) {
+    static const char digits[] = "0123456789abcdef";
+
+    // Each 64-bit value becomes a 16-character hexadecimal number, same as "%016" PRIx64
+    for (size_t i = 0; i < size_in_blocks; i++) {
+        LOOP(j, 16) {
+            text[i * 16 + j] = digits[(blocks[i] >> (60 - j * 4)) & 0xF];
+        }
+    }
+}
+
+static size_t count_hex_scalar(const char *text, size_t length) {
+    size_t digits = 0;
+    for (size_t i = 0; i < length; i++)
+        digits += hex_digit_values[(unsigned char)text[i]] != 0;
+    return digits;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 16 characters to nibble values, *valid gets a 0xFF byte for every hex digit
+__attribute__((target("ssse3"))) FORCE_INLINE __m128i hex_values_ssse3(__m128i chars, __m128i *valid) {
+    __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+    *valid = _mm_or_si128(is_digit, is_letter);
+    return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                        _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3"))) static size_t parse_hex_ssse3(const char *text, size_t length, hex_parser *parser,
+                                                               uint64_t *blocks) {
+    size_t count = 0, i = 0;
+
+    while (i < length) {
+        // Whole blocks of 16 digits go through the vector path, the scalar parser takes everything else
+        if (parser->digits == 0 && length - i >= 16) {
+            __m128i valid;
+            __m128i values = hex_values_ssse3(_mm_loadu_si128((const __m128i *)&text[i]), &valid);
+            if (_mm_movemask_epi8(valid) == 0xFFFF) {
+                // Pairs of nibbles to bytes, then the first character ends up in the top byte
+                __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(values, _mm_set1_epi16(0x0110)), values);
+                blocks[count++] = __builtin_bswap64(_mm_cvtsi128_si64(bytes));
+                i += 16;
+                continue;
+            }
+        }
+        // Scalar up to the next block boundary, so line breaks do not knock the rest off the vector path
+        do {
+            parse_hex_char(text[i++], parser, blocks, &count);
+        } while (i < length && parser->digits != 0);
+    }
+    return count;
+}
+
+__attribute__((target("ssse3"))) static void encode_hex_ssse3(const uint64_t *blocks, size_t size_in_blocks,
+                                                              char *text) {
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                         '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+
+    for (size_t i = 0; i < size_in_blocks; i++) {
+        // Big-endian bytes, split into high and low nibbles and interleaved, then one shuffle looks up all 16 digits
+        __m128i bytes = _mm_cvtsi64_si128(__builtin_bswap64(blocks[i]));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+        __m128i low = _mm_and_si128(bytes, _mm_set1_epi8(0x0F));
+        _mm_storeu_si128((__m128i *)&text[i * 16], _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(high, low)));
+    }
+}
+
+__attribute__((target("ssse3,popcnt"))) static size_t count_hex_ssse3(const char *text, size_t length) {
+    size_t digits = 0, i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i valid;
+        hex_values_ssse3(_mm_loadu_si128((const __m128i *)&text[i]), &valid);
+        digits += __builtin_popcount(_mm_movemask_epi8(valid));
+    }
+    return digits + count_hex_scalar(&text[i], length - i);
+}
+
+__attribute__((target("avx2"))) FORCE_INLINE __m256i hex_values_avx2(__m256i chars, __m256i *valid) {
+    __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    __m256i is_letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+    *valid = _mm256_or_si256(is_digit, is_letter);
+    return _mm256_or_si256(_mm256_and_si256(is_digit, digit),
+                           _mm256_and_si256(is_letter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2"))) static size_t parse_hex_avx2(const char *text, size_t length, hex_parser *parser,
+                                                             uint64_t *blocks) {
+    size_t count = 0, i = 0;
+
+    while (i < length) {
+        // Two blocks per step, or one if only the first 16 characters are all digits
+        if (parser->digits == 0 && length - i >= 32) {
+            __m256i valid;
+            __m256i values = hex_values_avx2(_mm256_loadu_si256((const __m256i *)&text[i]), &valid);
+            unsigned int mask = _mm256_movemask_epi8(valid);
+            __m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0110)), values);
+            if ((mask & 0xFFFF) == 0xFFFF) {
+                blocks[count++] = __builtin_bswap64(_mm256_extract_epi64(bytes, 0));
+                i += 16;
+                if (mask == 0xFFFFFFFF) {
+                    blocks[count++] = __builtin_bswap64(_mm256_extract_epi64(bytes, 2));
+                    i += 16;
+                }
+                continue;
+            }
+        }
+
+        // Scalar up to the next block boundary (the tail ends up here too)
+        do {
+            parse_hex_char(text[i++], parser, blocks, &count);
+        } while (i < length && parser->digits != 0);
+    }
+    return count;
+}
+
+__attribute__((target("avx2"))) static void encode_hex_avx2(const uint64_t *blocks, size_t size_in_blocks,
+                                                            char *text) {
+    const __m256i digits = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+                                            '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    size_t i = 0;
+
+    // Two blocks per step, one in each 128-bit lane
+    for (; i + 2 <= size_in_blocks; i += 2) {
+        __m256i bytes = _mm256_setr_epi64x(__builtin_bswap64(blocks[i]), 0, __builtin_bswap64(blocks[i + 1]), 0);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0F));
+        __m256i low = _mm256_and_si256(bytes, _mm256_set1_epi8(0x0F));
+        _mm256_storeu_si256((__m256i *)&text[i * 16], _mm256_shuffle_epi8(digits, _mm256_unpacklo_epi8(high, low)));
+    }
+    encode_hex_ssse3(&blocks[i], size_in_blocks - i, &text[i * 16]);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t count_hex_avx2(const char *text, size_t length) {
+    size_t digits = 0, i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i valid;
+        hex_values_avx2(_mm256_loadu_si256((const __m256i *)&text[i]), &valid);
+        digits += __builtin_popcount(_mm256_movemask_epi8(valid));
+    }
+    return digits + count_hex_scalar(&text[i], length - i);
+}
+
+static int cpu_has_ssse3(void) {
+    return __builtin_cpu_supports("ssse3");
+}
+#endif
+
+// Codecs from the widest to the narrowest, the scalar codec must stay last
+static const hex_codec hex_codecs[] = {
+#if defined(__x86_64__) || defined(__i386__)
+        {"avx2", cpu_has_avx2, parse_hex_avx2, encode_hex_avx2, count_hex_avx2},
+        {"ssse3", cpu_has_ssse3, parse_hex_ssse3, encode_hex_ssse3, count_hex_ssse3},
+#endif
+        {"scalar", always_supported, des_parse_hex_scalar, des_encode_hex_scalar, count_hex_scalar}
+};
+
+#define HEX_CODEC_COUNT (sizeof(hex_codecs) / sizeof(hex_codecs[0]))
+
+// Usable before init_library too (des_read_hex_blocks runs first), so it starts out scalar
+const hex_codec *des_selected_hex_codec = &hex_codecs[HEX_CODEC_COUNT - 1];
+
+static int hex_codec_self_test(const hex_codec *codec) {
+    // Every block value pattern, upper and lower case, separators inside and between blocks
+    static const char text[] = "0123456789abcdefFEDCBA9876543210 00112233 44556677\n8899aabbccddeeff"
+                               "0f1e2d3c4b5a6978A5A5A5A5A5A5A5A5:deadbeefcafebabe0123456789ABCDEF"
+                               "0000000000000000ffffffffffffffff";
+    static const uint64_t expected[] = {0x0123456789ABCDEF, 0xFEDCBA9876543210, 0x0011223344556677,
+                                        0x8899AABBCCDDEEFF, 0x0F1E2D3C4B5A6978, 0xA5A5A5A5A5A5A5A5,
+                                        0xDEADBEEFCAFEBABE, 0x0123456789ABCDEF, 0x0000000000000000,
+                                        0xFFFFFFFFFFFFFFFF};
+    enum { EXPECTED_BLOCKS = sizeof(expected) / sizeof(expected[0]) };
+    uint64_t blocks[EXPECTED_BLOCKS];
+    char encoded[EXPECTED_BLOCKS * 16], reference[EXPECTED_BLOCKS * 16];
+
+    // Parse in two pieces so a block straddles the calls
+    hex_parser parser = {0, 0};
+    size_t count = codec->parse(text, 40, &parser, blocks);
+    count += codec->parse(&text[40], sizeof(text) - 1 - 40, &parser, &blocks[count]);
+    if (count != EXPECTED_BLOCKS || parser.digits != 0 || memcmp(blocks, expected, sizeof(expected)) != 0 ||
+        codec->count(text, sizeof(text) - 1) != EXPECTED_BLOCKS * 16 || codec->count(&text[7], 50) != 47)
+        return 0;
+
+    codec->encode(expected, EXPECTED_BLOCKS, encoded);
+    des_encode_hex_scalar(expected, EXPECTED_BLOCKS, reference);
+    return memcmp(encoded, reference, sizeof(encoded)) == 0;
+}
+
+static void select_hex_codec(void) {
+    // DES_HEX=<name> forces one codec, like DES_ENGINE
+    const char *forced = getenv("DES_HEX");
+    const hex_codec *chosen = NULL;
+
+    const hex_codec *fastest = NULL;
+
+    LOOP(i, HEX_CODEC_COUNT) {
+        if (!hex_codecs[i].supported() || !hex_codec_self_test(&hex_codecs[i]))
+            continue;
+        if (fastest == NULL)
+            fastest = &hex_codecs[i];
+        if (chosen == NULL && (forced == NULL || strcmp(forced, hex_codecs[i].name) == 0))
+            chosen = &hex_codecs[i];
+    }
+
+    if (forced != NULL && chosen == NULL) {
+        fprintf(stderr, "Warning: hex codec '%s' is unknown or not usable here, using the fastest one\n", forced);
+        chosen = fastest;
+    }
+    if (chosen != NULL)
+        des_selected_hex_codec = chosen;
+}
+
+const hex_codec *des_find_hex_codec(const char *name) {
+    LOOP(i, HEX_CODEC_COUNT) {
+        if (strcmp(name, hex_codecs[i].name) == 0 && hex_codecs[i].supported() && hex_codec_self_test(&hex_codecs[i]))
+            return &hex_codecs[i];
+    }
+    return NULL;
+}
+
+size_t des_parse_hex_parallel(const char *text, size_t length, hex_parser *parser, uint64_t *blocks) {
+    // One thread or one range: nothing to split
+    size_t ranges = (length + HEX_RANGE_SIZE - 1) / HEX_RANGE_SIZE;
+    uint64_t *digits = pool.threads > 1 && ranges > 1 ? malloc((ranges + 1) * sizeof(uint64_t)) : NULL;
+    if (digits == NULL)
+        return des_parse_hex(text, length, parser, blocks);
+
+    // Count the digits of every range, then a prefix sum tells each one where its first digit goes
+    hex_split_job job = {.text = text, .length = length, .digits = digits, .carried = *parser, .left = {0, 0},
+                         .blocks = blocks};
+    parallel_for(ranges, count_hex_task, &job);
+    digits[0] = parser->digits;
+    for (size_t r = 0; r < ranges; r++)
+        digits[r + 1] += digits[r];
+    parallel_for(ranges, parse_hex_task, &job);
+
+    size_t count = digits[ranges] / 16;
+    *parser = job.left;
+    free(digits);
+    return count;
+}
+
+static void count_hex_task(void *context, uint64_t range) {
+    hex_split_job *job = context;
+    size_t start = range * HEX_RANGE_SIZE;
+    size_t length = job->length - start < HEX_RANGE_SIZE ? job->length - start : HEX_RANGE_SIZE;
+    STATS_START(counting);
+    job->digits[range + 1] = des_selected_hex_codec->count(&job->text[start], length);
+    STATS_STOP(counting, PHASE_PARSE, 0);
+}
+
+static void parse_hex_task(void *context, uint64_t range) {
+    hex_split_job *job = context;
+    size_t start = range * HEX_RANGE_SIZE;
+    size_t end = job->length - start < HEX_RANGE_SIZE ? job->length : start + HEX_RANGE_SIZE;
+
+    // The digits of a block that began in an earlier range are left to that range, which may be all of them
+    hex_parser parser = range == 0 ? job->carried : (hex_parser){0, 0};
+    unsigned int skip = range == 0 ? 0 : (16 - job->digits[range] % 16) % 16;
+    size_t i = start;
+    for (unsigned int left = skip; left > 0; i++) {
+        if (i == end)
+            return;
+        left -= hex_digit_values[(unsigned char)job->text[i]] != 0;
+    }
+
+    uint64_t *blocks = &job->blocks[(job->digits[range] + skip) / 16];
+    size_t count = des_parse_hex(&job->text[i], end - i, &parser, blocks);
+
+    // Finish the block that runs past the end of the range, the last one may stay incomplete for the next call
+    for (i = end; i < job->length && parser.digits != 0; i++)
+        parse_hex_char(job->text[i], &parser, blocks, &count);
+    if (parser.digits != 0)
+        job->left = parser;
+}
+
+static const uint64_t *cached_schedule(schedule_cache *cache, uint64_t key) {
+    // Parity bits are dropped by PC-1, so keys that only differ in them share a schedule
+    uint64_t tag = key & 0xFEFEFEFEFEFEFEFE;
+    unsigned char oldest = 0;
+
+    cache->clock++;
+    LOOP(i, SCHEDULE_CACHE_SIZE) {
+        if (cache->used[i] != 0 && cache->tags[i] == tag) {
+            cache->used[i] = cache->clock;
+            cache->hits++;
+            return cache->keys[i];
+        }
+        if (cache->used[i] < cache->used[oldest])
+            oldest = i;
+    }
+
+    // Miss: derive the schedule into the least recently used slot
+    cache->misses++;
+    cache->tags[oldest] = tag;
+    cache->used[oldest] = cache->clock;
+    des_generate_keys(key, cache->keys[oldest]);
+    return cache->keys[oldest];
+}
+
+void des_crypt_key_blocks(const uint64_t *des_keys, const uint64_t *input, char decrypting, uint64_t *output,
+                          size_t size_in_blocks, schedule_cache *cache) {
+    size_t i = 0;
+    while (i < size_in_blocks) {
+        // Runs of blocks under the same key still go through the multi-block engines
+        size_t run = 1;
+        while (i + run < size_in_blocks && des_keys[i + run] == des_keys[i])
+            run++;
+
+        const uint64_t *keys = cached_schedule(cache, des_keys[i]);
+        if (run >= 64) {
+            des_crypt_blocks(selected_engine, &input[i], keys, 16, decrypting, &output[i], run);
+        } else {
+            for (size_t j = i; j < i + run; j++)
+                des_crypt_block(input[j], keys, 16, decrypting, &output[j]);
+        }
+        i += run;
+    }
+}
+
+static const engine *search_engine(void) {
+    // The table engine cannot search, the scalar bitsliced one right before it always can
+    return selected_engine->search != NULL ? selected_engine : &engines[ENGINE_COUNT - 2];
+}
+
+static void search_task(void *context, uint64_t task) {
+    search_job *job = context;
+    des_key_search *search = job->search;
+    const engine *e = job->engine;
+    uint64_t base = job->first + task * SEARCH_TASK_KEYS;
+    uint64_t stop = job->end - base < SEARCH_TASK_KEYS ? job->end : base + SEARCH_TASK_KEYS;
+    uint64_t matches[MAX_ENGINE_BLOCKS / 64];
+
+    for (; base < stop; base += e->blocks) {
+        e->search(search->plain_text[0], search->cipher_text[0], base, matches);
+        for (unsigned int g = 0; g < e->blocks / 64; g++) {
+            for (uint64_t bits = matches[g]; bits != 0; bits &= bits - 1) {
+                // The first and the last call of a slice also try keys of the neighbouring slices
+                uint64_t index = base + g * 64 + __builtin_ctzll(bits);
+                uint64_t key = des_key_from_index(index);
+                if (index < job->begin || index >= job->end || !check_key(search, key))
+                    continue;
+
+                pthread_mutex_lock(&job->lock);
+                if (search->found_count < DES_SEARCH_MAX_FOUND)
+                    search->found[search->found_count++] = key;
+                pthread_mutex_unlock(&job->lock);
+            }
+        }
+    }
+}
+
+static int check_key(const des_key_search *search, uint64_t key) {
+    // A wrong key matches a pair with probability 2^-64, so over all 2^56 keys one pair gives about 2^-8 false
+    // matches in total (one in 256 full searches), and each further pair makes that 2^64 times fewer
+    uint64_t keys[16], cipher_text;
+    des_generate_keys(key, keys);
+    for (unsigned int i = 0; i < search->pairs; i++) {
+        des_crypt_block(search->plain_text[i], keys, 16, 0, &cipher_text);
+        if (cipher_text != search->cipher_text[i])
+            return 0;
+    }
+    return 1;
+}
+
+static int read_search_checkpoint(const char *name, des_key_search *search) {
+    // No checkpoint yet is a fresh start
+    FILE *file = fopen(name, "r");
+    if (file == NULL) {
+        if (errno == ENOENT)
+            return 0;
+        perror("Error opening checkpoint");
+        return 1;
+    }
+
+    des_key_search saved = {0};
+    char line[128];
+    unsigned int version = 0;
+    char valid = fgets(line, sizeof(line), file) != NULL && sscanf(line, "des-key-search %u", &version) == 1 &&
+                 version == 1;
+    while (valid && fgets(line, sizeof(line), file) != NULL) {
+        uint64_t a, b;
+        if (sscanf(line, "pair %" SCNx64 " %" SCNx64, &a, &b) == 2 && saved.pairs < 2) {
+            saved.plain_text[saved.pairs] = a;
+            saved.cipher_text[saved.pairs++] = b;
+        } else if (sscanf(line, "found %" SCNx64, &a) == 1 && saved.found_count < DES_SEARCH_MAX_FOUND) {
+            saved.found[saved.found_count++] = a;
+        } else {
+            valid = sscanf(line, "range %" SCNx64 " %" SCNx64, &saved.start, &saved.end) == 2 ||
+                    sscanf(line, "next %" SCNx64, &saved.next) == 1 || sscanf(line, "seconds %lf", &saved.seconds) == 1;
+        }
+    }
+    fclose(file);
+    if (!valid) {
+        fprintf(stderr, "Error: %s is not a key search checkpoint\n", name);
+        return 1;
+    }
+
+    // Progress only carries over to the same search
+    char same = saved.pairs == search->pairs && saved.start == search->start && saved.end == search->end &&
+                saved.next >= saved.start && saved.next <= saved.end;
+    for (unsigned int i = 0; same && i < saved.pairs; i++)
+        same = saved.plain_text[i] == search->plain_text[i] && saved.cipher_text[i] == search->cipher_text[i];
+    if (!same) {
+        fprintf(stderr, "Error: checkpoint %s belongs to another search (pairs or range differ)\n", name);
+        return 1;
+    }
+    search->next = saved.next;
+    search->seconds = saved.seconds;
+    search->found_count = saved.found_count;
+    memcpy(search->found, saved.found, sizeof(saved.found));
+    return 0;
+}
+
+static int write_search_checkpoint(const char *name, const des_key_search *search) {
+    // Written next to the old one and renamed over it, so an interrupted write leaves the old one in place
+    size_t length = strlen(name) + 5;
+    char *temporary = malloc(length);
+    if (temporary == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    snprintf(temporary, length, "%s.tmp", name);
+
+    FILE *file = fopen(temporary, "w");
+    if (file == NULL) {
+        perror("Error writing checkpoint");
+        free(temporary);
+        return 1;
+    }
+    fprintf(file, "des-key-search 1\n");
+    for (unsigned int i = 0; i < search->pairs; i++)
+        fprintf(file, "pair %016" PRIX64 " %016" PRIX64 "\n", search->plain_text[i], search->cipher_text[i]);
+    fprintf(file, "range %" PRIx64 " %" PRIx64 "\n", search->start, search->end);
+    fprintf(file, "next %" PRIx64 "\n", search->next);
+    fprintf(file, "seconds %.3f\n", search->seconds);
+    for (unsigned int i = 0; i < search->found_count; i++)
+        fprintf(file, "found %016" PRIX64 "\n", search->found[i]);
+
+    int status = 0;
+    if (fclose(file) != 0 || rename(temporary, name) != 0) {
+        perror("Error writing checkpoint");
+        status = 1;
+    }
+    free(temporary);
+    return status;
+}
+
+static int key_search(des_key_search *search, const char *checkpoint) {
+    if (search->pairs < 1 || search->pairs > 2 || search->start >= search->end || search->end > (uint64_t)1 << 56) {
+        fprintf(stderr, "Error: a key search takes one or two pairs and a range of 56-bit key indices\n");
+        return 1;
+    }
+    search->next = search->start;
+    search->seconds = 0;
+    search->found_count = 0;
+    if (checkpoint != NULL && read_search_checkpoint(checkpoint, search) != 0)
+        return 1;
+
+    // The range goes through in slices of about a second, so a match or an interrupt is never far behind.
+    // The first slice gives every thread one task to time the engine with.
+    search_job job = {.search = search, .engine = search_engine(), .lock = PTHREAD_MUTEX_INITIALIZER};
+    uint64_t slice_tasks = pool.threads;
+    unsigned int found_before = search->found_count, reported = search->found_count;
+    double since_checkpoint = 0;
+    int status = 0;
+    while (status == 0 && search->next < search->end && (search->all || search->found_count == found_before)) {
+        job.begin = search->next;
+        job.first = job.begin - job.begin % job.engine->blocks;
+        job.end = (search->end - job.first) / SEARCH_TASK_KEYS < slice_tasks ? search->end
+                                                                             : job.first + slice_tasks * SEARCH_TASK_KEYS;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint64_t tasks = (job.end - job.first + SEARCH_TASK_KEYS - 1) / SEARCH_TASK_KEYS;
+        parallel_for(tasks, search_task, &job);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+        search->next = job.end;
+        search->seconds += seconds;
+        since_checkpoint += seconds;
+        slice_tasks = seconds > 0 ? tasks / seconds : tasks * 2;
+        if (slice_tasks < pool.threads)
+            slice_tasks = pool.threads;
+        if (slice_tasks > (1 << 20))
+            slice_tasks = 1 << 20;
+
+        if (since_checkpoint >= search->interval || search->next == search->end || search->found_count != reported) {
+            since_checkpoint = 0;
+            reported = search->found_count;
+            if (checkpoint != NULL)
+                status = write_search_checkpoint(checkpoint, search);
+            if (search->progress != NULL)
+                search->progress(search);
+        }
+    }
+    pthread_mutex_destroy(&job.lock);
+    return status;
+}
+
+static int key_search_self_test(void) {
+    // Plant a key in a keyspace of 2^20 that starts off the engine width, then search it and the ranges on
+    // either side of the key (which must come up empty)
+    uint64_t mix = (uint64_t)time(NULL) * 0x9E3779B97F4A7C15;
+    uint64_t start = (mix >> 9) + 1, index = start + (mix & 0xFFFFF) % ((1 << 20) - 1);
+    uint64_t key = des_key_from_index(index), keys[16];
+    des_key_search search = {.plain_text = {0x0123456789ABCDEF, 0x4E6F772069732074}, .pairs = 2, .all = 1,
+                             .interval = 1e9};
+    des_generate_keys(key, keys);
+    LOOP(i, 2) {
+        des_crypt_block(search.plain_text[i], keys, 16, 0, &search.cipher_text[i]);
+    }
+
+    uint64_t ranges[3][2] = {{start, start + (1 << 20)}, {start, index}, {index + 1, start + (1 << 20)}};
+    LOOP(i, 3) {
+        search.start = ranges[i][0];
+        search.end = ranges[i][1];
+        if (search.start < search.end &&
+            (key_search(&search, NULL) != 0 || search.found_count != (i == 0) || (i == 0 && search.found[0] != key)))
+            return 0;
+    }
+    return 1;
+}
+
+static int compare_stream_lengths(const void *a, const void *b) {
+    // Longest first
+    size_t x = (*(des_stream *const *)a)->nbytes, y = (*(des_stream *const *)b)->nbytes;
+    return (x < y) - (x > y);
+}
+
+static void stream_task(void *context, uint64_t task) {
+    stream_job *job = context;
+    const des_ctx *cipher = job->cipher;
+    des_stream **group = &job->order[task * job->lanes];
+    size_t lanes = job->stream_count - task * job->lanes;
+    if (lanes > job->lanes)
+        lanes = job->lanes;
+    unsigned char passes = cipher->rounds / 16;
+    const engine *narrowest = &engines[ENGINE_COUNT - 2];
+
+    // Lane i is stream group[i]. The lanes past the end of the group are only ever padding of a narrowest call.
+    uint64_t chain[MAX_ENGINE_BLOCKS], cipher_text[MAX_ENGINE_BLOCKS];
+    uint64_t blocks[MAX_ENGINE_BLOCKS] = {0}, key_indices[3 * MAX_ENGINE_BLOCKS] = {0};
+    char shared = 1;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < lanes; i++) {
+        des_stream *stream = group[i];
+        chain[i] = stream->iv;
+        shared &= stream->des_keys == NULL;
+        bytes += stream->nbytes;
+        LOOP(p, passes) {
+            key_indices[i * passes + p] = stream->des_keys == NULL ? cipher->key_indices[p] :
+                                          des_key_index(stream->des_keys[p < stream->key_count ? p : 0]);
+        }
+    }
+
+    // Own schedules of the lanes the table engine takes, kept in slot i % 64: the tail is never wider than 64
+    // lanes and a lane only moves into it when the one that had its slot has finished
+    uint64_t tail_schedules[64][48];
+    size_t tail_lanes[64];
+    LOOP(i, 64) {
+        tail_lanes[i] = SIZE_MAX;
+    }
+
+    size_t active = lanes, steps = group[0]->nbytes / 8;
+    STATS_START(ciphering);
+    for (size_t t = 0; t < steps; t++) {
+        while (group[active - 1]->nbytes / 8 <= t)
+            active--;
+
+        // CBC: C[t] = E(P[t] ^ C[t - 1]) and P[t] = D(C[t]) ^ C[t - 1], with C[-1] the IV of the stream
+        for (size_t i = 0; i < active; i++) {
+            cipher_text[i] = des_load_block((const uint8_t *)group[i]->input + t * 8);
+            blocks[i] = job->decrypting ? cipher_text[i] : cipher_text[i] ^ chain[i];
+        }
+
+        size_t done;
+        if (shared) {
+            des_crypt_blocks(cipher->engine, blocks, cipher->keys, cipher->rounds, job->decrypting, blocks, active);
+            done = active;
+        } else {
+            done = crypt_lanes(cipher->engine, blocks, key_indices, cipher->rounds, job->decrypting, blocks, active);
+            // Half a call of the narrowest bitsliced engine still beats the table engine on the rest
+            if (active - done >= narrowest->blocks / 2 && cipher->engine->crypt_lanes != NULL &&
+                engine_usable[narrowest - engines]) {
+                narrowest->crypt_lanes(&blocks[done], &key_indices[done * passes], cipher->rounds, job->decrypting,
+                                       &blocks[done]);
+                done = active;
+            }
+        }
+        for (size_t i = done; i < active; i++) {
+            const uint64_t *schedule = cipher->keys;
+            if (group[i]->des_keys != NULL) {
+                if (tail_lanes[i % 64] != i) {
+                    unsigned char rounds;
+                    generate_schedule(group[i]->des_keys, group[i]->key_count, tail_schedules[i % 64], &rounds);
+                    tail_lanes[i % 64] = i;
+                }
+                schedule = tail_schedules[i % 64];
+            }
+            des_crypt_block(blocks[i], schedule, cipher->rounds, job->decrypting, &blocks[i]);
+        }
+
+        for (size_t i = 0; i < active; i++) {
+            des_store_block(job->decrypting ? blocks[i] ^ chain[i] : blocks[i], (uint8_t *)group[i]->output + t * 8);
+            chain[i] = job->decrypting ? cipher_text[i] : blocks[i];
+        }
+    }
+    STATS_STOP(ciphering, PHASE_CIPHER, bytes);
+}
+
+static int start_thread_pool(unsigned int threads) {
+    pool.threads = threads;
+    pool.queues = calloc(threads, sizeof(task_queue));
+    pool.workers = calloc(threads, sizeof(pthread_t));
+    if (pool.queues == NULL || pool.workers == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        pool.threads = 1;
+        return 1;
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.wake, NULL);
+    pthread_cond_init(&pool.finished, NULL);
+    pool.stopping = 0;
+
+    // The calling thread is worker 0, the others wait for parallel_for to hand them work
+    for (unsigned int i = 1; i < threads; i++) {
+        if (pthread_create(&pool.workers[i], NULL, pool_worker, (void *)(uintptr_t)i) != 0) {
+            perror("Error starting worker thread");
+            pool.threads = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void stop_thread_pool(void) {
+    if (pool.workers == NULL)
+        return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (unsigned int i = 1; i < pool.threads; i++)
+        pthread_join(pool.workers[i], NULL);
+    free(pool.workers);
+    free(pool.queues);
+    pool.workers = NULL;
+    pool.queues = NULL;
+    pool.threads = 1;
+}
+
+static int next_task(unsigned int self, uint64_t *index) {
+    // Take tasks from the front of our own range first
+    _Atomic uint64_t *own = &pool.queues[self].range;
+    uint64_t range = atomic_load(own);
+    while ((range >> 32) < (range & 0xFFFFFFFF)) {
+        if (atomic_compare_exchange_weak(own, &range, range + ((uint64_t)1 << 32))) {
+            *index = range >> 32;
+            return 1;
+        }
+    }
+
+    // Then steal the back half of another worker's range, run its first task and keep the rest
+    for (unsigned int k = 1; k < pool.threads; k++) {
+        _Atomic uint64_t *victim = &pool.queues[(self + k) % pool.threads].range;
+        range = atomic_load(victim);
+        while ((range >> 32) < (range & 0xFFFFFFFF)) {
+            uint64_t begin = range >> 32;
+            uint64_t end = range & 0xFFFFFFFF;
+            uint64_t middle = begin + (end - begin) / 2;
+            if (atomic_compare_exchange_weak(victim, &range, (begin << 32) | middle)) {
+                atomic_store(own, ((middle + 1) << 32) | end);
+                *index = middle;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void *pool_worker(void *arg) {
+    unsigned int self = (uintptr_t)arg;
+    unsigned long seen = 0;
+    pool_self = self;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (!pool.stopping && pool.generation == seen)
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        if (pool.stopping)
+            break;
+        seen = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        uint64_t index;
+        while (next_task(self, &index))
+            pool.task(pool.context, index);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.running == 0)
+            pthread_cond_signal(&pool.finished);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    stats_retire();
+    return NULL;
+}
+
+static void parallel_for(uint64_t tasks, void (*task)(void *context, uint64_t index), void *context) {
+    if (pool.threads <= 1 || tasks <= 1) {
+        for (uint64_t i = 0; i < tasks; i++)
+            task(context, i);
+        return;
+    }
+
+    // Give every worker an equal share up front, stealing evens out the tail
+    pthread_mutex_lock(&pool.submit);
+    for (unsigned int t = 0; t < pool.threads; t++) {
+        uint64_t begin = tasks * t / pool.threads;
+        uint64_t end = tasks * (t + 1) / pool.threads;
+        atomic_store(&pool.queues[t].range, (begin << 32) | end);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.task = task;
+    pool.context = context;
+    pool.running = pool.threads - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    uint64_t index;
+    while (next_task(0, &index))
+        task(context, index);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.running != 0)
+        pthread_cond_wait(&pool.finished, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.submit);
+}
+
+static void chunk_task(void *context, uint64_t task) {
+    chunk_job *job = context;
+    des_ctx *cipher = job->cipher;
+    size_t first = task * TASK_BLOCKS;
+    size_t count = job->size_in_blocks - first < TASK_BLOCKS ? job->size_in_blocks - first : TASK_BLOCKS;
+    uint64_t *blocks = &job->blocks[first];
+    STATS_START(ciphering);
+
+    if (job->input_bytes != NULL) {
+        for (size_t i = first; i < first + count && i < job->input_blocks; i++)
+            job->blocks[i] = des_load_block(&job->input_bytes[i * 8]);
+    }
+    const uint64_t *source = job->source != NULL ? &job->source[first] : blocks;
+
+    switch (cipher->mode) {
+        case DES_MODE_ECB:
+            des_crypt_blocks(cipher->engine, source, cipher->keys, cipher->rounds, job->decrypting, blocks, count);
+            break;
+
+        case DES_MODE_CBC:
+            if (job->decrypting) {
+                // P[i] = D(C[i]) ^ C[i - 1] only needs ciphertext, so every task can run on its own
+                des_crypt_blocks(cipher->engine, source, cipher->keys, cipher->rounds, 1, blocks, count);
+                blocks[0] ^= first == 0 ? job->chain : source[-1];
+                for (size_t i = 1; i < count; i++)
+                    blocks[i] ^= source[i - 1];
+            } else {
+                // C[i] = E(P[i] ^ C[i - 1]) is serial, run_chunk calls these tasks in order on one thread
+                for (size_t i = 0; i < count; i++) {
+                    des_crypt_block(source[i] ^ job->chain, cipher->keys, cipher->rounds, 0, &blocks[i]);
+                    job->chain = blocks[i];
+                }
+            }
+            break;
+
+        case DES_MODE_CTR: {
+            // The keystream is the encrypted counter, the same for both directions
+            uint64_t keystream[TASK_BLOCKS];
+            for (size_t i = 0; i < count; i++)
+                keystream[i] = job->chain + first + i;
+            des_crypt_blocks(cipher->engine, keystream, cipher->keys, cipher->rounds, 0, keystream, count);
+            for (size_t i = 0; i < count; i++)
+                blocks[i] = source[i] ^ keystream[i];
+            break;
+        }
+    }
+    STATS_STOP(ciphering, PHASE_CIPHER, count * 8);
+
+    if (job->output_text != NULL)
+        encode_hex(blocks, count, &job->output_text[first * 16]);
+    if (job->output_bytes != NULL) {
+        for (size_t i = first; i < first + count; i++)
+            des_store_block(job->blocks[i], &job->output_bytes[i * 8]);
+    }
+}
+
+static uint64_t run_chunk(chunk_job *job) {
+    uint64_t tasks = (job->size_in_blocks + TASK_BLOCKS - 1) / TASK_BLOCKS;
+
+    if (job->cipher->mode == DES_MODE_CBC && !job->decrypting) {
+        // Chained through every block, so no parallelism: the tasks run in order and carry job->chain along
+        for (uint64_t i = 0; i < tasks; i++)
+            chunk_task(job, i);
+        return job->chain;
+    }
+
+    if (job->serial) {
+        for (uint64_t i = 0; i < tasks; i++)
+            chunk_task(job, i);
+    } else {
+        parallel_for(tasks, chunk_task, job);
+    }
+
+    // Return the chaining value for the next chunk
+    if (job->cipher->mode == DES_MODE_CBC)
+        return job->size_in_blocks == 0 ? job->chain : job->source[job->size_in_blocks - 1];
+    if (job->cipher->mode == DES_MODE_CTR)
+        return job->chain + job->size_in_blocks;
+    return job->chain;
+}
+
+#if DES_STATS
+static thread_stats *stats_register(void) {
+    thread_stats *stats = calloc(1, sizeof(thread_stats));
+    if (stats == NULL) {
+        static thread_stats discarded;  // out of memory: count into a shared sink rather than fail the job
+        return &discarded;
+    }
+    pthread_mutex_lock(&stats_lock);
+    stats->index = stats_next_index++;
+    stats->next = stats_threads;
+    stats_threads = stats;
+    pthread_mutex_unlock(&stats_lock);
+    stats_self = stats;
+    return stats;
+}
+#endif
+
+static void stats_retire(void) {
+    // The counters outlive their thread in the retired totals, so a report still has the workers of a pool that
+    // was stopped since, but not their blocks: every restart of the pool and every file's I/O threads would add more
+    thread_stats *stats = stats_self;
+    if (stats == NULL)
+        return;
+    pthread_mutex_lock(&stats_lock);
+    for (thread_stats **link = &stats_threads; *link != NULL; link = &(*link)->next) {
+        if (*link == stats) {
+            *link = stats->next;
+            break;
+        }
+    }
+    LOOP(p, PHASE_COUNT) {
+        stats_retired.ticks[p] += stats->ticks[p];
+        stats_retired.calls[p] += stats->calls[p];
+        stats_retired.bytes[p] += stats->bytes[p];
+    }
+    pthread_mutex_unlock(&stats_lock);
+    free(stats);
+    stats_self = NULL;
+}
+
+// ##################################################################################################################
+// Library API
+// ##################################################################################################################
+
+static pthread_once_t library_once = PTHREAD_ONCE_INIT;
+
+static void init_library(void) {
+    // Build the fused lookup tables used by encrypt/decrypt and pick the fastest engine that passes its self-test
+    STATS_START(setup);
+    init_tables();
+    select_engine();
+    select_hex_codec();
+    STATS_STOP(setup, PHASE_SETUP, 0);
+}
+
+int des_init(des_ctx *ctx, const uint64_t *des_keys, unsigned int key_count, block_mode mode, uint64_t iv) {
+    if (key_count < 1 || key_count > 3) {
+        fprintf(stderr, "Error: DES takes one key, 3DES two or three\n");
+        return 1;
+    }
+    pthread_once(&library_once, init_library);
+
+    // Generate 16 keys for encryption/decryption (48 for 3DES)
+    memset(ctx, 0, sizeof(*ctx));
+    STATS_START(scheduling);
+    generate_schedule(des_keys, key_count, ctx->keys, &ctx->rounds);
+    STATS_STOP(scheduling, PHASE_KEYS, key_count * 8);
+    LOOP(k, 3) {
+        ctx->key_indices[k] = des_key_index(des_keys[k < key_count ? k : 0]);
+    }
+    ctx->mode = mode;
+    ctx->iv = iv;
+    ctx->chain = iv;
+    ctx->engine = selected_engine;
+    return 0;
+}
+
+void des_set_iv(des_ctx *ctx, uint64_t iv) {
+    ctx->iv = iv;
+    ctx->chain = iv;
+}
+
+int des_set_engine(des_ctx *ctx, const char *name) {
+    LOOP(i, ENGINE_COUNT) {
+        if (engine_usable[i] && strcmp(name, engines[i].name) == 0) {
+            ctx->engine = &engines[i];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int des_set_threads(unsigned int threads) {
+    stop_thread_pool();
+    return threads > 1 ? start_thread_pool(threads) : 0;
+}
+
+int des_encrypt_buffer(des_ctx *ctx, const void *input, void *output, size_t nbytes) {
+    return crypt_buffer(ctx, input, output, nbytes, 0);
+}
+
+int des_decrypt_buffer(des_ctx *ctx, const void *input, void *output, size_t nbytes) {
+    return crypt_buffer(ctx, input, output, nbytes, 1);
+}
+
+int des_encrypt_streams(des_ctx *ctx, des_stream *streams, size_t stream_count) {
+    return crypt_streams(ctx, streams, stream_count, 0);
+}
+
+int des_decrypt_streams(des_ctx *ctx, des_stream *streams, size_t stream_count) {
+    return crypt_streams(ctx, streams, stream_count, 1);
+}
+
+int des_encrypt_file(des_ctx *ctx, const char *input_name, const char *output_name, unsigned int flags) {
+    return crypt_file(ctx, input_name, output_name, flags, 0);
+}
+
+int des_decrypt_file(des_ctx *ctx, const char *input_name, const char *output_name, unsigned int flags) {
+    return crypt_file(ctx, input_name, output_name, flags, 1);
+}
+
+int des_set_pipeline(unsigned int depth, size_t chunk_size) {
+    if (chunk_size % 8 != 0 || chunk_size > (1u << 30) || depth > 1024) {
+        fprintf(stderr, "Error: the chunk size must be a multiple of 8 up to 1 GiB, the depth at most 1024\n");
+        return 1;
+    }
+    pipeline.depth = depth;
+    pipeline.chunk_size = chunk_size;
+    return 0;
+}
+
+int des_encrypt_batch(des_ctx *ctx, const char *input, const char *output_dir, des_batch_stats *stats) {
+    return crypt_batch(ctx, input, output_dir, 0, stats);
+}
+
+int des_decrypt_batch(des_ctx *ctx, const char *input, const char *output_dir, des_batch_stats *stats) {
+    return crypt_batch(ctx, input, output_dir, 1, stats);
+}
+
+int des_decrypt_range(des_ctx *ctx, const char *input_name, const char *output_name, uint64_t offset,
+                      uint64_t length) {
+    return decrypt_range(ctx, input_name, output_name, offset, length);
+}
+
+void des_stats_reset(void) {
+    // Other threads may be counting right now: their counters are atomic, and an add that straddles the reset
+    // at worst keeps a span from before it
+    pthread_mutex_lock(&stats_lock);
+    for (thread_stats *stats = stats_threads; stats != NULL; stats = stats->next) {
+        LOOP(p, PHASE_COUNT) {
+            atomic_store_explicit(&stats->ticks[p], 0, memory_order_relaxed);
+            atomic_store_explicit(&stats->calls[p], 0, memory_order_relaxed);
+            atomic_store_explicit(&stats->bytes[p], 0, memory_order_relaxed);
+        }
+    }
+    stats_retired = (thread_stats){0};
+    pthread_mutex_unlock(&stats_lock);
+#if DES_STATS
+    stats_start_ticks = stats_ticks();
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &stats_start_time);
+}
+
+int des_stats_print(const des_ctx *ctx, FILE *out, char json) {
+#if DES_STATS
+    static const char *const phase_names[PHASE_COUNT] = {"setup", "keys", "read", "parse", "cipher", "encode",
+                                                         "write", "wait"};
+
+    // Ticks become seconds at the rate they ran at since the reset
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t ticks = stats_ticks() - stats_start_ticks;
+    double wall = (now.tv_sec - stats_start_time.tv_sec) + (now.tv_nsec - stats_start_time.tv_nsec) * 1e-9;
+    double tick = ticks > 0 ? wall / ticks : 0;
+
+    struct rusage usage;
+    long peak_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;   // KiB on Linux
+
+    pthread_mutex_lock(&stats_lock);
+    thread_stats total = stats_retired;
+    for (thread_stats *stats = stats_threads; stats != NULL; stats = stats->next) {
+        LOOP(p, PHASE_COUNT) {
+            total.ticks[p] += stats->ticks[p];
+            total.calls[p] += stats->calls[p];
+            total.bytes[p] += stats->bytes[p];
+        }
+    }
+    uint64_t blocks = total.bytes[PHASE_CIPHER] / 8;
+    const char *engine_name = ctx != NULL ? ctx->engine->name : selected_engine->name;
+
+    if (json) {
+        fprintf(out, "{\"engine\": \"%s\", \"threads\": %u, \"wall_s\": %.6f, \"peak_rss_kb\": %ld, "
+                     "\"blocks\": %" PRIu64 ", \"blocks_per_s\": %.0f, \"phases\": {",
+                engine_name, pool.threads, wall, peak_kb, blocks, wall > 0 ? blocks / wall : 0);
+        LOOP(p, PHASE_COUNT) {
+            fprintf(out, "%s\"%s\": {\"s\": %.6f, \"calls\": %" PRIu64 ", \"bytes\": %" PRIu64 "}",
+                    p == 0 ? "" : ", ", phase_names[p], total.ticks[p] * tick, total.calls[p], total.bytes[p]);
+        }
+        fprintf(out, "}, \"per_thread\": [");
+        const char *separator = "";
+        for (thread_stats *stats = stats_threads; stats != NULL; stats = stats->next) {
+            uint64_t busy = 0, calls = 0;
+            LOOP(p, PHASE_COUNT) {
+                busy += stats->ticks[p];
+                calls += stats->calls[p];
+            }
+            if (calls == 0)
+                continue;
+            fprintf(out, "%s{\"thread\": %u, \"busy_s\": %.6f, \"cipher_s\": %.6f, \"blocks\": %" PRIu64 "}",
+                    separator, stats->index, busy * tick, stats->ticks[PHASE_CIPHER] * tick,
+                    stats->bytes[PHASE_CIPHER] / 8);
+            separator = ", ";
+        }
+        fprintf(out, "]}\n");
+    } else {
+        // Phase times add up over the threads, so with several threads they can exceed the wall time
+        fprintf(out, "Stats: engine %s, %u threads, %.3f s wall, peak RSS %.1f MB\n", engine_name, pool.threads, wall,
+                peak_kb / 1024.0);
+        fprintf(out, "  %-8s %10s %10s %12s %10s\n", "phase", "seconds", "calls", "MB", "MB/s");
+        LOOP(p, PHASE_COUNT) {
+            double seconds = total.ticks[p] * tick;
+            fprintf(out, "  %-8s %10.4f %10" PRIu64 " %12.2f %10.1f\n", phase_names[p], seconds, total.calls[p],
+                    total.bytes[p] / 1e6, seconds > 0 ? total.bytes[p] / 1e6 / seconds : 0);
+        }
+        fprintf(out, "  %" PRIu64 " blocks, %.2f M blocks/s over the wall time\n", blocks,
+                wall > 0 ? blocks / wall / 1e6 : 0);
+        for (thread_stats *stats = stats_threads; stats != NULL; stats = stats->next) {
+            if (stats->calls[PHASE_CIPHER] != 0)
+                fprintf(out, "  thread %u: %.4f s cipher, %" PRIu64 " blocks\n", stats->index,
+                        stats->ticks[PHASE_CIPHER] * tick, stats->bytes[PHASE_CIPHER] / 8);
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+    return 0;
+#else
+    (void)ctx;
+    (void)out;
+    (void)json;
+    return 1;
+#endif
+}
+
+int des_key_search_run(des_key_search *search, const char *checkpoint) {
+    pthread_once(&library_once, init_library);
+    return key_search(search, checkpoint);
+}
+
+int des_key_search_self_test(void) {
+    pthread_once(&library_once, init_library);
+    return key_search_self_test();
+}
+
+uint64_t des_key_from_index(uint64_t index) {
+    // Seven key bits per byte above the parity bit, which makes the number of ones in the byte odd
+    uint64_t key = 0;
+    LOOP(j, 8) {
+        uint64_t bits = (index >> (7 * j)) & 0x7F;
+        key |= ((bits << 1) | !(__builtin_popcountll(bits) & 1)) << (8 * j);
+    }
+    return key;
+}
+
+uint64_t des_key_index(uint64_t key) {
+    uint64_t index = 0;
+    LOOP(j, 8) {
+        index |= ((key >> (8 * j + 1)) & 0x7F) << (7 * j);
+    }
+    return index;
+}
+
+static int crypt_buffer(des_ctx *ctx, const uint8_t *input, uint8_t *output, size_t nbytes, char decrypting) {
+    if (nbytes % 8 != 0) {
+        fprintf(stderr, "Error: buffer length must be a multiple of 8 bytes\n");
+        return 1;
+    }
+
+    if (nbytes == 0)
+        return 0;
+
+    // Work through the buffer in pieces so the scratch blocks stay bounded
+    size_t size_in_blocks = nbytes / 8;
+    size_t piece_blocks = (size_t)CHUNK_SIZE / 8 * pool.threads;
+    if (piece_blocks > size_in_blocks)
+        piece_blocks = size_in_blocks;
+    char chained = ctx->mode == DES_MODE_CBC && decrypting;
+    size_t scratch_blocks = (chained ? 2 : 1) * piece_blocks;
+    uint64_t *blocks = piece_blocks <= SIZE_MAX / 2 / sizeof(uint64_t) ? malloc(scratch_blocks * sizeof(uint64_t))
+                                                                       : NULL;
+    if (blocks == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    uint64_t *cipher_text = &blocks[piece_blocks];
+
+    for (size_t first = 0; first < size_in_blocks; first += piece_blocks) {
+        size_t count = size_in_blocks - first < piece_blocks ? size_in_blocks - first : piece_blocks;
+        chunk_job job = {.cipher = ctx, .decrypting = decrypting, .blocks = blocks, .size_in_blocks = count,
+                         .chain = ctx->chain, .output_bytes = &output[first * 8]};
+
+        // CBC decryption reads the previous ciphertext block, so it must not be overwritten in place
+        if (chained) {
+            for (size_t i = 0; i < count; i++)
+                cipher_text[i] = des_load_block(&input[(first + i) * 8]);
+            job.source = cipher_text;
+        } else {
+            job.input_bytes = &input[first * 8];
+            job.input_blocks = count;
+        }
+        ctx->chain = run_chunk(&job);
+    }
+
+    free(blocks);
+    return 0;
+}
+
+static int crypt_streams(des_ctx *cipher, des_stream *streams, size_t stream_count, char decrypting) {
+    if (stream_count == 0)
+        return 0;
+    des_stream **order = stream_count <= SIZE_MAX / sizeof(des_stream *) ? malloc(stream_count * sizeof(des_stream *))
+                                                                         : NULL;
+    if (order == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < stream_count; i++) {
+        des_stream *stream = &streams[i];
+        if (stream->nbytes % 8 != 0 || (stream->des_keys != NULL &&
+                                        (stream->key_count < 1 || stream->key_count > 3 ||
+                                         (stream->key_count > 1 ? 48 : 16) != cipher->rounds))) {
+            fprintf(stderr, "Error: stream %zu needs a multiple of 8 bytes and %s keys like its context\n", i,
+                            cipher->rounds == 16 ? "DES" : "3DES");
+            free(order);
+            return 1;
+        }
+        order[i] = stream;
+    }
+    qsort(order, stream_count, sizeof(des_stream *), compare_stream_lengths);
+
+    // A group as wide as the engine, but narrower ones (down to 64 streams) when that keeps every thread busy
+    unsigned int lanes = cipher->engine->blocks < 64 ? 64 : cipher->engine->blocks;
+    while (lanes > 64 && (stream_count + lanes / 2 - 1) / (lanes / 2) <= pool.threads)
+        lanes /= 2;
+    stream_job job = {.cipher = cipher, .order = order, .stream_count = stream_count, .lanes = lanes,
+                      .decrypting = decrypting};
+    parallel_for((stream_count + lanes - 1) / lanes, stream_task, &job);
+
+    free(order);
+    return 0;
+}
+
+static int crypt_file(des_ctx *ctx, const char *input_name, const char *output_name, unsigned int flags,
+                      char decrypting) {
+    // Open input file (plaintext for encryption or ciphertext for decryption)
+    FILE *input = fopen(input_name, "rb");
+    if (input == NULL) {
+        perror("Error opening input file");
+        return 1;
+    }
+
+    // Ciphertext that starts with the container magic is a container, anything else is hex. Regular files go
+    // back to the start after sniffing, from a pipe or FIFO the sniffed bytes are handed on to the hex parser.
+    char container = !decrypting && (flags & DES_CONTAINER);
+    struct stat input_info;
+    char regular = fstat(fileno(input), &input_info) == 0 && S_ISREG(input_info.st_mode);
+    uint8_t magic[8];
+    size_t sniffed = 0;
+    if (decrypting) {
+        sniffed = fread(magic, 1, 8, input);
+        container = sniffed == 8 && memcmp(magic, container_magic, 8) == 0;
+        if (regular && fseeko(input, 0, SEEK_SET) != 0) {
+            perror("Error reading input file");
+            fclose(input);
+            return 1;
+        }
+        if (regular)
+            sniffed = 0;
+        if (container && !regular) {
+            fprintf(stderr, "Error: containers can only be decrypted from regular files, not from a pipe\n");
+            fclose(input);
+            return 1;
+        }
+    }
+
+    if ((flags & DES_MMAP) && !container && regular) {
+        // Map both files and work on the mappings directly (a pipe cannot be mapped, it is streamed instead)
+        fclose(input);
+        return decrypting ? decrypt_mapped(input_name, output_name, ctx) : encrypt_mapped(input_name, output_name, ctx);
+    }
+
+    // The output is written while the input is still being read, so it must not be the input
+    if (same_file(fileno(input), output_name)) {
+        fprintf(stderr, "Error: %s would overwrite itself, choose another output file\n", input_name);
+        fclose(input);
+        return 1;
+    }
+    FILE *output = fopen(output_name, "wb");
+    if (output == NULL) {
+        perror("Error opening output file");
+        fclose(input);
+        return 1;
+    }
+
+    // Stream the input through the cipher one chunk at a time, regular files as a pipeline that reads and
+    // writes while the cipher runs (pipes and the like cannot be read or written at an offset)
+    int status;
+    struct stat output_info;
+    char pipelined = pipeline.depth > 0 && regular && fstat(fileno(output), &output_info) == 0 &&
+                     S_ISREG(output_info.st_mode);
+    if (container)
+        status = decrypting ? decrypt_container(input, output, ctx) : encrypt_container(input, output, ctx);
+    else if (pipelined)
+        status = crypt_pipelined(input, output, ctx, decrypting);
+    else
+        status = decrypting ? decrypt_stream(input, output, ctx, magic, sniffed) : encrypt_stream(input, output, ctx);
+
+    fclose(input);
+    if (fclose(output) != 0 && status == 0) {
+        perror("Error writing to file");
+        status = 1;
+    }
+    return status;
+}
+
+static int same_file(int input, const char *output_name) {
+    struct stat input_info, output_info;
+    return fstat(input, &input_info) == 0 && S_ISREG(input_info.st_mode) && stat(output_name, &output_info) == 0 &&
+           input_info.st_dev == output_info.st_dev && input_info.st_ino == output_info.st_ino;
+}
@@ -0,0 +1,154 @@
+// ##################################################################################################################
+/*
+ * libdes: DES and 3DES (EDE2/EDE3) in ECB, CBC and CTR mode.
+ *
+ * This is the library API. The interface between des.c and the command line tools is in des_internal.h.
+ */
+
+#ifndef DES_H
+#define DES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define DES_API __attribute__((visibility("default")))
+#define DES_SEARCH_MAX_FOUND 16     // matching keys a des_key_search keeps
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ##################################################################################################################
+// Library API
+// ##################################################################################################################
+
+// modes of operation
+typedef enum {
+    DES_MODE_ECB,
+    DES_MODE_CBC,
+    DES_MODE_CTR
+} block_mode;
+
+struct des_engine;             // a block engine, internal
+
+// cipher context: everything needed to encrypt or decrypt with one key (set), set up once by des_init
+typedef struct {
+    uint64_t keys[48];          // round keys in encryption order: 16 for DES, 48 for 3DES (E K1, D K2, E K3)
+    unsigned char rounds;       // 16 or 48
+    block_mode mode;
+    uint64_t iv;                // CBC: chaining block before the first one, CTR: counter of the first block
+    uint64_t chain;             // where the next des_*_buffer call carries on from
+    uint64_t key_indices[3];    // K1, K2, K3 (K1 again for EDE2) as key indices, for des_*_streams
+    const struct des_engine *engine;    // widest engine to use, narrower ones take the tail
+} des_ctx;
+
+// One key is DES, two or three keys are 3DES EDE2/EDE3. The IV is ignored in ECB mode. Returns 0 on success.
+DES_API int des_init(des_ctx *ctx, const uint64_t *des_keys, unsigned int key_count, block_mode mode, uint64_t iv);
+
+// Restart the CBC/CTR chain, e.g. before the next message
+DES_API void des_set_iv(des_ctx *ctx, uint64_t iv);
+
+// Use a specific engine ("avx512", "avx2", "sse2", "bitslice" or "table"), returns 1 if it is not usable here
+DES_API int des_set_engine(des_ctx *ctx, const char *name);
+
+// Worker threads shared by all contexts (1 = run on the calling thread), not while a buffer is being processed
+DES_API int des_set_threads(unsigned int threads);
+
+// Raw big-endian blocks, no padding: nbytes must be a multiple of 8. input may equal output, and consecutive
+// calls continue the CBC/CTR chain
+DES_API int des_encrypt_buffer(des_ctx *ctx, const void *input, void *output, size_t nbytes);
+
+DES_API int des_decrypt_buffer(des_ctx *ctx, const void *input, void *output, size_t nbytes);
+
+// Many independent CBC messages at once, each with its own IV and optionally its own keys. Block t of every stream
+// goes through the multi-block engine together with block t of the others, so a stream waits for one engine call
+// per block instead of the rounds of its previous block. The mode and chain of ctx are not used.
+typedef struct {
+    const void *input;
+    void *output;               // may equal input
+    size_t nbytes;              // a multiple of 8, the streams may differ in length
+    uint64_t iv;
+    const uint64_t *des_keys;   // key_count keys of this stream (DES or 3DES, like ctx), NULL for the keys of ctx
+    unsigned int key_count;
+} des_stream;
+
+DES_API int des_encrypt_streams(des_ctx *ctx, des_stream *streams, size_t stream_count);
+
+DES_API int des_decrypt_streams(des_ctx *ctx, des_stream *streams, size_t stream_count);
+
+// Whole files: binary plaintext, PKCS#5 padding, hex ciphertext or (DES_CONTAINER) the binary container format.
+// Decryption recognises containers by themselves and takes the mode and IV from their header.
+#define DES_MMAP 1                  // map the files instead of streaming them (hex format only)
+#define DES_CONTAINER 2             // write the binary container format instead of hex
+
+DES_API int des_encrypt_file(des_ctx *ctx, const char *input_name, const char *output_name, unsigned int flags);
+
+DES_API int des_decrypt_file(des_ctx *ctx, const char *input_name, const char *output_name, unsigned int flags);
+
+// Files are read, processed and written as a pipeline of depth chunks of chunk_size bytes each (a multiple of 8),
+// through io_uring or, without it or with DES_IO=threads, a reader and a writer thread. Depth 0 processes one
+// chunk after the other, chunk_size 0 is 1 MiB per worker thread. Not while a file is being processed.
+DES_API int des_set_pipeline(unsigned int depth, size_t chunk_size);
+
+// Many files in one go: input is a directory (every regular file in it) or a manifest with one input file per
+// line, optionally followed by a tab and its output file. Outputs go to output_dir under the input file's name.
+// The files are spread over the worker threads, hex ciphertext only. stats may be NULL.
+typedef struct {
+    uint64_t files;             // done
+    uint64_t failed;
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    double seconds;
+} des_batch_stats;
+
+DES_API int des_encrypt_batch(des_ctx *ctx, const char *input, const char *output_dir, des_batch_stats *stats);
+
+DES_API int des_decrypt_batch(des_ctx *ctx, const char *input, const char *output_dir, des_batch_stats *stats);
+
+// Decrypt only plaintext bytes [offset, offset + length) of a hex or container file, reading just the blocks that
+// cover them (length UINT64_MAX: up to the end). Containers and hex without separators are read in place.
+DES_API int des_decrypt_range(des_ctx *ctx, const char *input_name, const char *output_name, uint64_t offset,
+                              uint64_t length);
+
+// Known-plaintext DES key search. Keys are counted by their index, the 56 key bits without the parity bits
+// (des_key_from_index adds them back), and [start, end) is searched on the worker threads. A second pair weeds
+// out false matches. With a checkpoint file the search saves its progress there every interval seconds and picks
+// up from it when run again. It stops after the first match unless all is set; more runs carry on after it.
+typedef struct des_key_search {
+    uint64_t plain_text[2];
+    uint64_t cipher_text[2];
+    unsigned int pairs;         // 1 or 2
+    uint64_t start;
+    uint64_t end;               // at most 1 << 56
+    char all;                   // search the whole range even after a match
+    double interval;            // seconds between checkpoints and progress calls
+    void (*progress)(const struct des_key_search *search);   // after every checkpoint, may be NULL
+    // results, also restored from the checkpoint
+    uint64_t next;              // every index below has been searched
+    double seconds;             // spent searching, over all runs
+    uint64_t found[DES_SEARCH_MAX_FOUND];       // matching keys (with parity)
+    unsigned int found_count;
+} des_key_search;
+
+DES_API int des_key_search_run(des_key_search *search, const char *checkpoint);
+
+// Plants a key in a small keyspace and searches for it, returns 1 if it is found (and nothing else)
+DES_API int des_key_search_self_test(void);
+
+// Time, calls and bytes per phase (setup, key schedule, read, hex parse, cipher, hex encode, write, I/O wait),
+// counted per thread. Reset before a job and print after it, as text or one JSON object, with the engine of ctx
+// (may be NULL), the thread count and the peak RSS. Returns 1 if the library was built with DES_STATS 0.
+DES_API void des_stats_reset(void);
+
+DES_API int des_stats_print(const des_ctx *ctx, FILE *out, char json);
+
+DES_API uint64_t des_key_from_index(uint64_t index);
+
+DES_API uint64_t des_key_index(uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
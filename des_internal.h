@@ -0,0 +1,169 @@
+// ##################################################################################################################
+/*
+ * libdes internals: the interface between des.c and the command line tools, hidden from the shared library. C only,
+ * programs using the library include des.h.
+ */
+
+#ifndef DES_INTERNAL_H
+#define DES_INTERNAL_H
+
+#include "des.h"
+
+#define LOOP(i, n) for (unsigned char i = 0; i < (n); ++i)
+#define HEX_RANGE_SIZE (1 << 18)    // hex text per thread pool task of des_parse_hex_parallel
+#define SCHEDULE_CACHE_SIZE 16  // key schedules kept by a schedule_cache
+#define CONTAINER_HEADER_SIZE 64
+#define PIPELINE_DEPTH 4            // default chunks in flight between reading and writing
+#define DAEMON_REQUEST_HEADER 24
+#define DAEMON_RESPONSE_HEADER 12
+#define DAEMON_MAX_PAYLOAD (16 << 20)
+
+// ##################################################################################################################
+// Internal Function Prototypes
+// ##################################################################################################################
+
+// a block engine, see the engines table in des.c
+typedef struct des_engine {
+    const char *name;
+    unsigned int blocks;    // blocks per call
+    int (*supported)(void);
+    void (*crypt)(const uint64_t *input, const uint64_t *keys, unsigned char rounds, char decrypting, uint64_t *output);
+    // every block with keys of its own: key p of block i is key_indices[i * rounds / 16 + p] (see des_key_index)
+    void (*crypt_lanes)(const uint64_t *input, const uint64_t *key_indices, unsigned char rounds, char decrypting,
+                        uint64_t *output);
+    // try the keys of index base .. base + blocks - 1 on one pair, bit j of matches[g] is key base + g * 64 + j
+    void (*search)(uint64_t plain_text, uint64_t cipher_text, uint64_t base, uint64_t *matches);
+} engine;
+
+// read and write functions
+typedef struct {
+    uint64_t block;         // hex digits collected so far for the current block
+    unsigned char digits;   // how many of them
+} hex_parser;
+
+uint64_t des_load_block(const uint8_t bytes[8]);
+
+void des_store_block(uint64_t block, uint8_t bytes[8]);
+
+size_t des_parse_hex(const char *text, size_t length, hex_parser *parser, uint64_t *blocks);
+
+// hex codec selection (scalar, SSSE3, AVX2), des_parse_hex and encode_hex go through the selected one
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    size_t (*parse)(const char *text, size_t length, hex_parser *parser, uint64_t *blocks);
+    void (*encode)(const uint64_t *blocks, size_t size_in_blocks, char *text);
+    size_t (*count)(const char *text, size_t length);   // hex digits in the text
+} hex_codec;
+
+size_t des_parse_hex_scalar(const char *text, size_t length, hex_parser *parser, uint64_t *blocks);
+
+void des_encode_hex_scalar(const uint64_t *blocks, size_t size_in_blocks, char *text);
+
+const hex_codec *des_find_hex_codec(const char *name);
+
+// des_parse_hex on the worker threads, same results (from the calling thread, not inside a pool task)
+size_t des_parse_hex_parallel(const char *text, size_t length, hex_parser *parser, uint64_t *blocks);
+
+extern const hex_codec *des_selected_hex_codec;
+
+int des_read_hex_blocks(const char *filename, uint64_t *blocks, unsigned int *size_in_blocks);
+
+// daemon protocol (desd and loadgen): frames over a Unix stream socket, all integers big-endian
+//  request:    0   length      4 bytes, payload bytes
+//              4   op          1 byte, daemon_op
+//              5   mode        1 byte, block_mode
+//              6   reserved    2 bytes of zeros
+//              8   key_id      4 bytes, one of the keys the daemon was started with
+//              12  request_id  4 bytes, echoed in the response
+//              16  iv          8 bytes, every request is a message of its own (ignored in ECB mode)
+//              24  payload     raw blocks as in des_encrypt_buffer, a multiple of 8 bytes, no padding
+//  response:   0   length      4 bytes, payload bytes (0 unless the status is STATUS_OK)
+//              4   status      1 byte, daemon_status
+//              5   reserved    3 bytes of zeros
+//              8   request_id  4 bytes
+//              12  payload
+// Responses come back in request order on each connection.
+typedef enum {
+    OP_ENCRYPT = 1,
+    OP_DECRYPT = 2
+} daemon_op;
+
+typedef enum {
+    STATUS_OK,
+    STATUS_UNKNOWN_KEY,
+    STATUS_BAD_REQUEST,         // unknown op or mode, or a length that is not a multiple of 8
+    STATUS_TOO_LARGE            // over DAEMON_MAX_PAYLOAD, the daemon closes the connection after it
+} daemon_status;
+
+typedef struct {
+    uint32_t length;
+    unsigned char op;
+    unsigned char mode;
+    uint32_t key_id;
+    uint32_t request_id;
+    uint64_t iv;
+} daemon_request;
+
+typedef struct {
+    uint32_t length;
+    unsigned char status;
+    uint32_t request_id;
+} daemon_response;
+
+void des_encode_daemon_request(const daemon_request *request, uint8_t bytes[DAEMON_REQUEST_HEADER]);
+
+void des_decode_daemon_request(const uint8_t bytes[DAEMON_REQUEST_HEADER], daemon_request *request);
+
+void des_encode_daemon_response(const daemon_response *response, uint8_t bytes[DAEMON_RESPONSE_HEADER]);
+
+void des_decode_daemon_response(const uint8_t bytes[DAEMON_RESPONSE_HEADER], daemon_response *response);
+
+// permutation functions
+void des_initial_permutation(uint64_t input, uint64_t *output);
+
+void des_initial_permutation_fast(uint64_t input, uint64_t *output);
+
+// key generation functions
+void des_generate_keys(uint64_t key, uint64_t keys[16]);
+
+void des_generate_keys_reference(uint64_t key, uint64_t keys[16]);
+
+// encryption functions
+void des_s_box(uint64_t input, uint64_t *output);
+
+void des_f_function(uint64_t right, uint64_t key, uint64_t *output);
+
+void des_f_function_fast(uint64_t right, uint64_t key, uint64_t *output);
+
+void des_encrypt_block(uint64_t plain_text, uint64_t keys[16], uint64_t *cipher_text);
+
+void des_decrypt_block(uint64_t cipher_text, uint64_t keys[16], uint64_t *plain_text);
+
+void des_crypt_block(uint64_t input, const uint64_t *keys, unsigned char rounds, char decrypting, uint64_t *output);
+
+// engine selection
+// 1 if the constant bitslice_s_box_leaves table is s_box_table regrouped
+int des_bitslice_leaves_self_test(void);
+
+void des_crypt_blocks(const engine *widest, const uint64_t *input, const uint64_t *keys, unsigned char rounds,
+                      char decrypting, uint64_t *output, uint64_t size_in_blocks);
+
+// key-agile batches (every block carries its own key), a cache belongs to one thread
+typedef struct {
+    uint64_t tags[SCHEDULE_CACHE_SIZE];         // keys without their parity bits
+    uint64_t used[SCHEDULE_CACHE_SIZE];         // clock of the last use, 0 = empty
+    uint64_t keys[SCHEDULE_CACHE_SIZE][16];
+    uint64_t clock;
+    uint64_t hits, misses;
+} schedule_cache;
+
+void des_crypt_key_blocks(const uint64_t *des_keys, const uint64_t *input, char decrypting, uint64_t *output,
+                          size_t size_in_blocks, schedule_cache *cache);
+
+// reference (bit-by-bit) encryption functions
+void des_encrypt_reference(uint64_t plain_text, uint64_t keys[16], uint64_t *cipher_text);
+
+void des_decrypt_reference(uint64_t cipher_text, uint64_t keys[16], uint64_t *plain_text);
+
+#endif
@@ -0,0 +1,203 @@
+// ##################################################################################################################
+/*
+ * keysearch: known-plaintext exhaustive DES key search on all cores, see des_key_search in des.h.
+ *
+ *      keysearch [options] <pair file>
+ *      keysearch --self-test
+ *
+ * The pair file holds a plaintext block and its ciphertext (16 hex digits each), optionally followed by a second
+ * pair to weed out false matches. Keys are counted by their index, the 56 key bits without the parity bits.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "des_internal.h"
+
+
+// ##################################################################################################################
+// Function Prototypes
+// ##################################################################################################################
+
+// command line
+typedef struct {
+    const char *pair_file;
+    const char *checkpoint;
+    unsigned int threads;
+    uint64_t start;
+    uint64_t end;
+    double interval;
+    char all;
+    char self_test;
+} search_options;
+
+int parse_search_options(int argc, char **argv, search_options *opts);
+
+int parse_index(const char *text, uint64_t *value);
+
+void print_progress(const des_key_search *search);
+
+// ##################################################################################################################
+
+
+// ##################################################################################################################
+// Main Function
+// ##################################################################################################################
+
+int main(int argc, char **argv) {
+    search_options opts;
+    if (parse_search_options(argc, argv, &opts) != 0)
+        return 1;
+    if (des_set_threads(opts.threads) != 0)
+        return 1;
+
+    if (opts.self_test) {
+        int passed = des_key_search_self_test();
+        des_set_threads(1);
+        printf(passed ? "Key search self-test passed.\n" : "Key search self-test FAILED.\n");
+        return !passed;
+    }
+
+    uint64_t blocks[4];
+    unsigned int block_count = 4;
+    if (des_read_hex_blocks(opts.pair_file, blocks, &block_count) != 0)
+        return 1;
+    if (block_count != 2 && block_count != 4) {
+        printf("Error: %s must hold one or two plaintext/ciphertext pairs\n", opts.pair_file);
+        return 1;
+    }
+
+    des_key_search search = {.pairs = block_count / 2, .start = opts.start, .end = opts.end, .all = opts.all,
+                             .interval = opts.interval, .progress = print_progress};
+    for (unsigned int i = 0; i < search.pairs; i++) {
+        search.plain_text[i] = blocks[2 * i];
+        search.cipher_text[i] = blocks[2 * i + 1];
+    }
+
+    int status = des_key_search_run(&search, opts.checkpoint);
+    des_set_threads(1);
+    if (status != 0)
+        return 1;
+
+    for (unsigned int i = 0; i < search.found_count; i++)
+        printf("Found key %016" PRIX64 " (index 0x%014" PRIx64 ")\n", search.found[i], des_key_index(search.found[i]));
+    if (search.found_count == 0)
+        printf("No key found in [0x%" PRIx64 ", 0x%" PRIx64 ").\n", search.start, search.end);
+    return search.found_count == 0;
+}
+
+// ##################################################################################################################
+
+
+// ##################################################################################################################
+// Function Definitions
+// ##################################################################################################################
+
+
+int parse_search_options(int argc, char **argv, search_options *opts) {
+    static const struct option long_options[] = {
+            {"threads", required_argument, NULL, 'j'},
+            {"start", required_argument, NULL, 's'},
+            {"end", required_argument, NULL, 'e'},
+            {"bits", required_argument, NULL, 'n'},
+            {"checkpoint", required_argument, NULL, 'C'},
+            {"interval", required_argument, NULL, 'i'},
+            {"all", no_argument, NULL, 'a'},
+            {"self-test", no_argument, NULL, 't'},
+            {NULL, 0, NULL, 0}
+    };
+
+    memset(opts, 0, sizeof(*opts));
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->threads = cores > 0 ? cores : 1;
+    opts->end = (uint64_t)1 << 56;
+    opts->interval = 60;
+
+    int option;
+    char usage = 0;
+    unsigned long bits = 0;
+    while ((option = getopt_long(argc, argv, "j:s:e:n:C:i:at", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'j':
+                opts->threads = strtoul(optarg, NULL, 10);
+                usage |= opts->threads < 1 || opts->threads > 1024;
+                break;
+            case 's':
+            case 'e':
+                if (parse_index(optarg, option == 's' ? &opts->start : &opts->end) != 0) {
+                    printf("Error: '%s' is not a key index below 2^56\n", optarg);
+                    usage = 1;
+                }
+                break;
+            case 'n':
+                bits = strtoul(optarg, NULL, 10);
+                usage |= bits < 1 || bits > 56;
+                break;
+            case 'C':
+                opts->checkpoint = optarg;
+                break;
+            case 'i':
+                opts->interval = strtod(optarg, NULL);
+                usage |= opts->interval <= 0;
+                break;
+            case 'a':
+                opts->all = 1;
+                break;
+            case 't':
+                opts->self_test = 1;
+                break;
+            default:
+                usage = 1;
+                break;
+        }
+    }
+
+    // --bits searches a keyspace of 2^bits keys from the start
+    if (bits != 0) {
+        opts->end = opts->start + ((uint64_t)1 << bits);
+        if (opts->end > (uint64_t)1 << 56) {
+            printf("Error: the range ends past 2^56\n");
+            usage = 1;
+        }
+    }
+
+    if (usage || argc - optind != !opts->self_test) {
+        printf("Usage: %s [options] <pair file>\n", argv[0]);
+        printf("       %s --self-test\n", argv[0]);
+        printf("The pair file holds a plaintext and its ciphertext (16 hex digits each), optionally a second pair.\n");
+        printf("Options:\n");
+        printf("  -j, --threads N          worker threads (default: all cores)\n");
+        printf("  -s, --start INDEX        first key index, the key without its parity bits (default: 0)\n");
+        printf("  -e, --end INDEX          end of the range, exclusive (default: 2^56)\n");
+        printf("  -n, --bits N             search 2^N keys from the start instead\n");
+        printf("  -C, --checkpoint FILE    save the progress to FILE and resume from it\n");
+        printf("  -i, --interval SECONDS   seconds between checkpoints and progress lines (default: 60)\n");
+        printf("  -a, --all                search the whole range instead of stopping at the first match\n");
+        printf("  -t, --self-test          plant a key in a keyspace of 2^20 keys and recover it\n");
+        return 1;
+    }
+    opts->pair_file = opts->self_test ? NULL : argv[optind];
+    return 0;
+}
+
+int parse_index(const char *text, uint64_t *value) {
+    // Decimal or 0x hex, at most 2^56 (the end of the whole keyspace)
+    char *end;
+    errno = 0;
+    *value = strtoull(text, &end, 0);
+    return errno != 0 || end == text || *end != '\0' || text[0] == '-' || *value > (uint64_t)1 << 56;
+}
+
+void print_progress(const des_key_search *search) {
+    double done = (double)(search->next - search->start);
+    double rate = search->seconds > 0 ? done / search->seconds : 0;
+    printf("Searched %.2f%% (up to index 0x%014" PRIx64 "), %.0f s, %.2f Mkeys/s, %u found\n",
+           100 * done / (double)(search->end - search->start), search->next, search->seconds, rate / 1e6,
+           search->found_count);
+    fflush(stdout);
+}
@@ -0,0 +1,318 @@
+// ##################################################################################################################
+/*
+ * Load generator for desd: every connection runs on a thread of its own and keeps up to depth requests in
+ * flight, then the latencies of all requests are merged. Prints one CSV row (or JSON object with -f json):
+ *
+ *      connections, depth, bytes, requests, seconds, requests_per_s, mb_per_s, p50_us, p99_us, p999_us
+ *
+ * bytes is the payload of each request, latency runs from sending a request to receiving its whole response.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "des_internal.h"
+
+
+// ##################################################################################################################
+// Function Prototypes
+// ##################################################################################################################
+
+// command line
+typedef struct {
+    const char *socket_path;
+    unsigned int connections;
+    unsigned int depth;         // requests in flight per connection
+    uint64_t requests;          // per connection
+    uint32_t size;              // payload bytes per request
+    uint32_t key_id;
+    daemon_op op;
+    block_mode mode;
+    char json;
+} load_options;
+
+int parse_load_options(int argc, char **argv, load_options *opts);
+
+// connections
+typedef struct {
+    const load_options *opts;
+    unsigned int index;
+    pthread_t thread;
+    double *latencies;          // microseconds, one per request
+    uint64_t failed;
+    int status;
+} load_connection;
+
+double now(void);
+
+int send_all(int fd, const uint8_t *bytes, size_t length);
+
+int receive_all(int fd, uint8_t *bytes, size_t length);
+
+void *run_connection(void *arg);
+
+int compare_doubles(const void *a, const void *b);
+
+// ##################################################################################################################
+
+
+// ##################################################################################################################
+// Main Function
+// ##################################################################################################################
+
+int main(int argc, char **argv) {
+    load_options opts;
+    if (parse_load_options(argc, argv, &opts) != 0)
+        return 1;
+
+    load_connection *connections = calloc(opts.connections, sizeof(load_connection));
+    uint64_t total = opts.requests * opts.connections;
+    double *latencies = malloc(total * sizeof(double));
+    if (connections == NULL || latencies == NULL) {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+
+    double start = now();
+    unsigned int started = 0;
+    for (; started < opts.connections; started++) {
+        connections[started] = (load_connection){.opts = &opts, .index = started,
+                                                 .latencies = &latencies[started * opts.requests]};
+        if (pthread_create(&connections[started].thread, NULL, run_connection, &connections[started]) != 0) {
+            perror("Error starting connection thread");
+            break;
+        }
+    }
+
+    int status = started == opts.connections ? 0 : 1;
+    uint64_t failed = 0;
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(connections[i].thread, NULL);
+        status |= connections[i].status;
+        failed += connections[i].failed;
+    }
+    double seconds = now() - start;
+    if (status != 0) {
+        free(connections);
+        free(latencies);
+        return 1;
+    }
+    if (failed != 0)
+        fprintf(stderr, "Error: %" PRIu64 " requests came back with an error status\n", failed);
+
+    qsort(latencies, total, sizeof(double), compare_doubles);
+    double p50 = latencies[total / 2], p99 = latencies[total * 99 / 100], p999 = latencies[total * 999 / 1000];
+    double rate = total / seconds, mb_per_s = total * (double)opts.size / seconds / 1e6;
+    if (opts.json) {
+        printf("{\"connections\": %u, \"depth\": %u, \"bytes\": %" PRIu32 ", \"requests\": %" PRIu64
+               ", \"seconds\": %.3f, \"requests_per_s\": %.0f, \"mb_per_s\": %.2f, \"p50_us\": %.1f, "
+               "\"p99_us\": %.1f, \"p999_us\": %.1f}\n",
+               opts.connections, opts.depth, opts.size, total, seconds, rate, mb_per_s, p50, p99, p999);
+    } else {
+        printf("connections,depth,bytes,requests,seconds,requests_per_s,mb_per_s,p50_us,p99_us,p999_us\n");
+        printf("%u,%u,%" PRIu32 ",%" PRIu64 ",%.3f,%.0f,%.2f,%.1f,%.1f,%.1f\n", opts.connections, opts.depth,
+               opts.size, total, seconds, rate, mb_per_s, p50, p99, p999);
+    }
+
+    free(connections);
+    free(latencies);
+    return failed != 0;
+}
+
+// ##################################################################################################################
+
+
+// ##################################################################################################################
+// Function Definitions
+// ##################################################################################################################
+
+
+int parse_load_options(int argc, char **argv, load_options *opts) {
+    static const struct option long_options[] = {
+            {"connections", required_argument, NULL, 'c'},
+            {"depth", required_argument, NULL, 'd'},
+            {"requests", required_argument, NULL, 'n'},
+            {"size", required_argument, NULL, 's'},
+            {"key", required_argument, NULL, 'k'},
+            {"decrypt", no_argument, NULL, 'D'},
+            {"block-mode", required_argument, NULL, 'b'},
+            {"format", required_argument, NULL, 'f'},
+            {NULL, 0, NULL, 0}
+    };
+
+    *opts = (load_options){.connections = 4, .depth = 1, .requests = 10000, .size = 64, .op = OP_ENCRYPT,
+                           .mode = DES_MODE_ECB};
+    int option;
+    char usage = 0;
+    while ((option = getopt_long(argc, argv, "c:d:n:s:k:Db:f:", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'c':
+                opts->connections = strtoul(optarg, NULL, 10);
+                usage |= opts->connections < 1 || opts->connections > 1024;
+                break;
+            case 'd':
+                opts->depth = strtoul(optarg, NULL, 10);
+                usage |= opts->depth < 1 || opts->depth > 4096;
+                break;
+            case 'n':
+                opts->requests = strtoull(optarg, NULL, 10);
+                usage |= opts->requests < 1;
+                break;
+            case 's':
+                opts->size = strtoul(optarg, NULL, 10);
+                usage |= opts->size % 8 != 0 || opts->size > DAEMON_MAX_PAYLOAD;
+                break;
+            case 'k':
+                opts->key_id = strtoul(optarg, NULL, 0);
+                break;
+            case 'D':
+                opts->op = OP_DECRYPT;
+                break;
+            case 'b':
+                opts->mode = strcmp(optarg, "cbc") == 0 ? DES_MODE_CBC :
+                             strcmp(optarg, "ctr") == 0 ? DES_MODE_CTR : DES_MODE_ECB;
+                usage |= opts->mode == DES_MODE_ECB && strcmp(optarg, "ecb") != 0;
+                break;
+            case 'f':
+                opts->json = strcmp(optarg, "json") == 0;
+                usage |= !opts->json && strcmp(optarg, "csv") != 0;
+                break;
+            default:
+                usage = 1;
+                break;
+        }
+    }
+
+    if (usage || argc - optind != 1) {
+        printf("Usage: %s [options] <socket>\n", argv[0]);
+        printf("Options:\n");
+        printf("  -c, --connections N      concurrent connections, one thread each (default: 4)\n");
+        printf("  -d, --depth N            requests in flight per connection (default: 1)\n");
+        printf("  -n, --requests N         requests per connection (default: 10000)\n");
+        printf("  -s, --size BYTES         payload per request, a multiple of 8 (default: 64)\n");
+        printf("  -k, --key ID             key ID to use (default: 0)\n");
+        printf("  -D, --decrypt            send decrypt requests instead of encrypt ones\n");
+        printf("  -b, --block-mode MODE    ecb (default), cbc or ctr\n");
+        printf("  -f, --format FORMAT      csv (default) or json\n");
+        return 1;
+    }
+    opts->socket_path = argv[optind];
+    return 0;
+}
+
+double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+int send_all(int fd, const uint8_t *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t count = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return 1;
+        bytes += count;
+        length -= count;
+    }
+    return 0;
+}
+
+int receive_all(int fd, uint8_t *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t count = recv(fd, bytes, length, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return 1;
+        bytes += count;
+        length -= count;
+    }
+    return 0;
+}
+
+void *run_connection(void *arg) {
+    load_connection *conn = arg;
+    const load_options *opts = conn->opts;
+    conn->status = 1;
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    strncpy(address.sun_path, opts->socket_path, sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror(opts->socket_path);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    // One frame, sent again and again with a new request ID. The send times are kept in a ring of depth.
+    uint8_t *request = malloc(DAEMON_REQUEST_HEADER + opts->size);
+    uint8_t *response = malloc(DAEMON_RESPONSE_HEADER + opts->size);
+    double *sent_at = malloc(opts->depth * sizeof(double));
+    if (request == NULL || response == NULL || sent_at == NULL) {
+        printf("Error: out of memory\n");
+        free(request);
+        free(response);
+        free(sent_at);
+        close(fd);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < opts->size; i++)
+        request[DAEMON_REQUEST_HEADER + i] = (uint8_t)(i * 131 + conn->index);
+    daemon_request header = {.length = opts->size, .op = opts->op, .mode = opts->mode, .key_id = opts->key_id,
+                             .iv = 0x0001020304050607};
+
+    // Keep depth requests in flight, the daemon answers each connection in order
+    uint64_t sent = 0, received = 0;
+    int status = 0;
+    while (received < opts->requests && status == 0) {
+        while (sent < opts->requests && sent - received < opts->depth && status == 0) {
+            header.request_id = sent;
+            des_encode_daemon_request(&header, request);
+            sent_at[sent % opts->depth] = now();
+            status = send_all(fd, request, DAEMON_REQUEST_HEADER + opts->size);
+            sent++;
+        }
+
+        daemon_response answer;
+        if (status != 0 || receive_all(fd, response, DAEMON_RESPONSE_HEADER) != 0) {
+            status = 1;
+            break;
+        }
+        des_decode_daemon_response(response, &answer);
+        if (answer.request_id != (uint32_t)received || answer.length > opts->size ||
+            receive_all(fd, &response[DAEMON_RESPONSE_HEADER], answer.length) != 0) {
+            status = 1;
+            break;
+        }
+        conn->failed += answer.status != STATUS_OK;
+        conn->latencies[received] = (now() - sent_at[received % opts->depth]) * 1e6;
+        received++;
+    }
+    if (status != 0)
+        printf("Error: connection %u to %s failed after %" PRIu64 " responses\n", conn->index, opts->socket_path,
+               received);
+
+    free(request);
+    free(response);
+    free(sent_at);
+    close(fd);
+    conn->status = status;
+    return NULL;
+}
+
+int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,878 @@
+// ##################################################################################################################
+/*
+ * Differential verification of libdes: every engine, hex codec and fast path is checked against the bit-by-bit
+ * reference functions (des_generate_keys_reference, des_encrypt_reference and des_decrypt_reference, kept as the
+ * oracle) and the standard DES known answers, and the hex and container readers are fuzzed. `make check` runs it.
+ *
+ *      verify [-n blocks] [-k keys] [-f files] [-s seed]
+ *
+ * Everything is drawn from one seeded generator, a failure prints the seed to repeat the run with.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "des_internal.h"
+
+#define MAX_REPORTED_FAILURES 10
+
+
+// ##################################################################################################################
+// Function Prototypes
+// ##################################################################################################################
+
+// command line
+typedef struct {
+    uint64_t blocks;            // random blocks through every engine
+    uint64_t keys;              // random keys through the key schedule, and per search engine (in calls)
+    uint64_t files;             // files through the fuzzed readers
+    uint64_t seed;
+} verify_options;
+
+int parse_verify_options(int argc, char **argv, verify_options *opts);
+
+// checks
+typedef struct {
+    const char *name;
+    void (*run)(const verify_options *opts);
+} verify_test;
+
+uint64_t next_random(void);
+
+void expect(int ok, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void reference_schedules(const uint64_t *des_keys, unsigned int key_count, uint64_t keys[3][16]);
+
+void reference_crypt(uint64_t input, uint64_t keys[3][16], unsigned int key_count, char decrypting, uint64_t *output);
+
+// tests
+void verify_known_answers(const verify_options *opts);
+
+void verify_key_schedules(const verify_options *opts);
+
+void verify_engines(const verify_options *opts);
+
+void verify_key_search(const verify_options *opts);
+
+void verify_modes(const verify_options *opts);
+
+void verify_key_agile(const verify_options *opts);
+
+void verify_streams(const verify_options *opts);
+
+void verify_hex_codecs(const verify_options *opts);
+
+void verify_readers(const verify_options *opts);
+
+// ##################################################################################################################
+
+const char *engine_names[] = {"avx512", "avx2", "sse2", "bitslice", "table"};
+const char *hex_codec_names[] = {"avx2", "ssse3", "scalar"};
+
+uint64_t random_state;
+uint64_t checks, failures, test_failures;
+
+
+// ##################################################################################################################
+// Main Function
+// ##################################################################################################################
+
+int main(int argc, char **argv) {
+    verify_options opts;
+    if (parse_verify_options(argc, argv, &opts) != 0)
+        return 1;
+
+    // des_init sets up the tables and engines the lower level functions need
+    des_ctx ctx;
+    uint64_t key = 0x133457799BBCDFF1;
+    if (des_init(&ctx, &key, 1, DES_MODE_ECB, 0) != 0)
+        return 1;
+    random_state = opts.seed;
+
+    static const verify_test tests[] = {
+            {"known answers", verify_known_answers},
+            {"key schedules", verify_key_schedules},
+            {"engines", verify_engines},
+            {"key search", verify_key_search},
+            {"modes", verify_modes},
+            {"key-agile", verify_key_agile},
+            {"streams", verify_streams},
+            {"hex codecs", verify_hex_codecs},
+            {"readers", verify_readers}
+    };
+
+    struct timespec start, end;
+    double seconds = 0;
+    LOOP(t, sizeof(tests) / sizeof(tests[0])) {
+        uint64_t before = checks;
+        test_failures = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        tests[t].run(&opts);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+        seconds += elapsed;
+        printf("%-4s %-14s %12" PRIu64 " checks %8.2f s\n", test_failures == 0 ? "ok" : "FAIL", tests[t].name,
+               checks - before, elapsed);
+        fflush(stdout);
+    }
+
+    if (failures != 0) {
+        printf("%" PRIu64 " of %" PRIu64 " checks FAILED, repeat with -s 0x%" PRIx64 "\n", failures, checks,
+               opts.seed);
+        return 1;
+    }
+    printf("All %" PRIu64 " checks passed in %.2f s (seed 0x%" PRIx64 ")\n", checks, seconds, opts.seed);
+    return 0;
+}
+
+// ##################################################################################################################
+
+
+// ##################################################################################################################
+// Function Definitions
+// ##################################################################################################################
+
+
+int parse_verify_options(int argc, char **argv, verify_options *opts) {
+    static const struct option long_options[] = {
+            {"blocks", required_argument, NULL, 'n'},
+            {"keys", required_argument, NULL, 'k'},
+            {"files", required_argument, NULL, 'f'},
+            {"seed", required_argument, NULL, 's'},
+            {NULL, 0, NULL, 0}
+    };
+
+    *opts = (verify_options){.blocks = 1 << 18, .keys = 1 << 19, .files = 400,
+                             .seed = (uint64_t)time(NULL) * 0x9E3779B97F4A7C15 | 1};
+    int option;
+    char usage = 0;
+    while ((option = getopt_long(argc, argv, "n:k:f:s:", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'n':
+                opts->blocks = strtoull(optarg, NULL, 0);
+                break;
+            case 'k':
+                opts->keys = strtoull(optarg, NULL, 0);
+                break;
+            case 'f':
+                opts->files = strtoull(optarg, NULL, 0);
+                break;
+            case 's':
+                // xorshift never leaves 0, so the seed is kept odd
+                opts->seed = strtoull(optarg, NULL, 0) | 1;
+                break;
+            default:
+                usage = 1;
+                break;
+        }
+    }
+
+    if (usage || optind != argc) {
+        printf("Usage: %s [options]\n", argv[0]);
+        printf("Options:\n");
+        printf("  -n, --blocks N           random blocks through every engine (default: 256K)\n");
+        printf("  -k, --keys N             random keys through the key schedules and the key search (default: 512K)\n");
+        printf("  -f, --files N            files through the fuzzed readers (default: 400)\n");
+        printf("  -s, --seed N             seed of the random generator (default: from the time)\n");
+        return 1;
+    }
+    return 0;
+}
+
+uint64_t next_random(void) {
+    // xorshift64*
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545F4914F6CDD1D;
+}
+
+void expect(int ok, const char *format, ...) {
+    checks++;
+    if (ok)
+        return;
+    if (failures++ < MAX_REPORTED_FAILURES) {
+        // stdout, the readers test silences stderr
+        va_list args;
+        va_start(args, format);
+        printf("  mismatch: ");
+        vprintf(format, args);
+        printf("\n");
+        va_end(args);
+    }
+    test_failures++;
+}
+
+void reference_schedules(const uint64_t *des_keys, unsigned int key_count, uint64_t keys[3][16]) {
+    LOOP(k, key_count) {
+        des_generate_keys_reference(des_keys[k], keys[k]);
+    }
+}
+
+void reference_crypt(uint64_t input, uint64_t keys[3][16], unsigned int key_count, char decrypting, uint64_t *output) {
+    // DES, or 3DES as three reference passes: E K1, D K2, E K3 (EDE2 reuses K1 as K3)
+    if (key_count == 1) {
+        if (decrypting)
+            des_decrypt_reference(input, keys[0], output);
+        else
+            des_encrypt_reference(input, keys[0], output);
+        return;
+    }
+
+    uint64_t *first = keys[0], *last = key_count == 3 ? keys[2] : keys[0];
+    if (decrypting) {
+        des_decrypt_reference(input, last, output);
+        des_encrypt_reference(*output, keys[1], output);
+        des_decrypt_reference(*output, first, output);
+    } else {
+        des_encrypt_reference(input, first, output);
+        des_decrypt_reference(*output, keys[1], output);
+        des_encrypt_reference(*output, last, output);
+    }
+}
+
+void verify_known_answers(const verify_options *opts) {
+    (void)opts;
+    // key, plaintext, ciphertext: the textbook example, classic DES test vectors and the first entries of the
+    // SP 800-17 variable plaintext and variable key tests
+    static const uint64_t des_vectors[][3] = {
+            {0x133457799BBCDFF1, 0x0123456789ABCDEF, 0x85E813540F0AB405},
+            {0x0000000000000000, 0x0000000000000000, 0x8CA64DE9C1B123A7},
+            {0xFFFFFFFFFFFFFFFF, 0xFFFFFFFFFFFFFFFF, 0x7359B2163E4EDC58},
+            {0x3000000000000000, 0x1000000000000001, 0x958E6E627A05557B},
+            {0x1111111111111111, 0x1111111111111111, 0xF40379AB9E0EC533},
+            {0x0123456789ABCDEF, 0x1111111111111111, 0x17668DFC7292532D},
+            {0x1111111111111111, 0x0123456789ABCDEF, 0x8A5AE1F81AB8F2DD},
+            {0xFEDCBA9876543210, 0x0123456789ABCDEF, 0xED39D950FA74BCC4},
+            {0x0E329232EA6D0D73, 0x8787878787878787, 0x0000000000000000},
+            {0x0101010101010101, 0x8000000000000000, 0x95F8A5E5DD31D900},
+            {0x0101010101010101, 0x4000000000000000, 0xDD7F121CA5015619},
+            {0x8001010101010101, 0x0000000000000000, 0x95A8D72813DAA94D},
+            {0x4001010101010101, 0x0000000000000000, 0x0EEC1487DD8C26D5},
+    };
+    // K1, K2, K3, plaintext, ciphertext (the SP 800-67 example)
+    static const uint64_t triple_vectors[][5] = {
+            {0x0123456789ABCDEF, 0x23456789ABCDEF01, 0x456789ABCDEF0123, 0x5468652071756663, 0xA826FD8CE53B855F},
+    };
+
+    for (size_t v = 0; v < sizeof(des_vectors) / sizeof(des_vectors[0]); v++) {
+        uint64_t key = des_vectors[v][0], plain_text = des_vectors[v][1], cipher_text = des_vectors[v][2];
+        uint64_t keys[16], output;
+        des_generate_keys_reference(key, keys);
+        des_encrypt_reference(plain_text, keys, &output);
+        expect(output == cipher_text, "reference DES of %016" PRIX64 " under %016" PRIX64, plain_text, key);
+        des_decrypt_reference(cipher_text, keys, &output);
+        expect(output == plain_text, "reference DES decryption under %016" PRIX64, key);
+
+        des_generate_keys(key, keys);
+        des_encrypt_block(plain_text, keys, &output);
+        expect(output == cipher_text, "table DES of %016" PRIX64 " under %016" PRIX64, plain_text, key);
+
+        // Every engine through a whole call of the same block
+        des_ctx ctx;
+        uint64_t blocks[512];
+        des_init(&ctx, &key, 1, DES_MODE_ECB, 0);
+        LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+            if (des_set_engine(&ctx, engine_names[e]) != 0)
+                continue;
+            for (unsigned int i = 0; i < ctx.engine->blocks; i++)
+                blocks[i] = plain_text;
+            ctx.engine->crypt(blocks, ctx.keys, ctx.rounds, 0, blocks);
+            expect(blocks[0] == cipher_text && blocks[ctx.engine->blocks - 1] == cipher_text,
+                   "%s DES known answer %zu", engine_names[e], v);
+        }
+    }
+
+    for (size_t v = 0; v < sizeof(triple_vectors) / sizeof(triple_vectors[0]); v++) {
+        uint64_t output, keys[3][16];
+        reference_schedules(triple_vectors[v], 3, keys);
+        reference_crypt(triple_vectors[v][3], keys, 3, 0, &output);
+        expect(output == triple_vectors[v][4], "reference 3DES known answer %zu", v);
+
+        des_ctx ctx;
+        uint64_t blocks[512];
+        des_init(&ctx, triple_vectors[v], 3, DES_MODE_ECB, 0);
+        LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+            if (des_set_engine(&ctx, engine_names[e]) != 0)
+                continue;
+            for (unsigned int i = 0; i < ctx.engine->blocks; i++)
+                blocks[i] = triple_vectors[v][3];
+            ctx.engine->crypt(blocks, ctx.keys, ctx.rounds, 0, blocks);
+            expect(blocks[0] == triple_vectors[v][4], "%s 3DES known answer %zu", engine_names[e], v);
+        }
+    }
+}
+
+void verify_key_schedules(const verify_options *opts) {
+    for (uint64_t i = 0; i < opts->keys; i++) {
+        uint64_t key = next_random(), fast[16], reference[16];
+        des_generate_keys(key, fast);
+        des_generate_keys_reference(key, reference);
+        expect(memcmp(fast, reference, sizeof(fast)) == 0, "generate_keys of %016" PRIX64, key);
+
+        // The key search counts keys by index: parity bits come back odd, and the index survives the round trip
+        uint64_t index = key >> 8;
+        uint64_t with_parity = des_key_from_index(index);
+        char odd = 1;
+        LOOP(j, 8) {
+            odd &= __builtin_popcountll((with_parity >> (8 * j)) & 0xFF) & 1;
+        }
+        expect(odd && des_key_index(with_parity) == index &&
+               (des_key_from_index(des_key_index(key)) & 0xFEFEFEFEFEFEFEFE) == (key & 0xFEFEFEFEFEFEFEFE),
+               "key index %014" PRIx64, index);
+
+        // The table-driven single block functions, once per 16 keys to stay quick
+        if (i % 16 == 0) {
+            uint64_t block = next_random(), fast_output, reference_output;
+            des_encrypt_block(block, fast, &fast_output);
+            des_encrypt_reference(block, reference, &reference_output);
+            expect(fast_output == reference_output, "encrypt of %016" PRIX64 " under %016" PRIX64, block, key);
+            des_decrypt_block(block, fast, &fast_output);
+            des_decrypt_reference(block, reference, &reference_output);
+            expect(fast_output == reference_output, "decrypt of %016" PRIX64 " under %016" PRIX64, block, key);
+        }
+    }
+}
+
+void verify_engines(const verify_options *opts) {
+    // A bitsliced engine whose self-test fails is dropped quietly, so check its S-box table (and that the portable
+    // one is there) first
+    des_ctx probe;
+    uint64_t probe_key = 0;
+    des_init(&probe, &probe_key, 1, DES_MODE_ECB, 0);
+    expect(des_bitslice_leaves_self_test(), "bitslice S-box leaves against s_box_table");
+    expect(des_set_engine(&probe, "bitslice") == 0, "bitslice engine passes its self-test");
+
+    // Every round draws DES, EDE2 or EDE3 keys and 512 blocks, the reference output is worked out once
+    static uint64_t plain_text[512], expected[512], output[512], decrypted[512];
+    for (uint64_t round = 0; round < (opts->blocks + 511) / 512; round++) {
+        uint64_t des_keys[3] = {next_random(), next_random(), next_random()}, keys[3][16];
+        unsigned int key_count = 1 + next_random() % 3;
+        reference_schedules(des_keys, key_count, keys);
+        for (unsigned int i = 0; i < 512; i++) {
+            plain_text[i] = next_random();
+            reference_crypt(plain_text[i], keys, key_count, 0, &expected[i]);
+        }
+
+        des_ctx ctx;
+        des_init(&ctx, des_keys, key_count, DES_MODE_ECB, 0);
+        LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+            if (des_set_engine(&ctx, engine_names[e]) != 0)
+                continue;
+            const engine *engine = ctx.engine;
+            for (unsigned int i = 0; i < 512; i += engine->blocks) {
+                engine->crypt(&plain_text[i], ctx.keys, ctx.rounds, 0, &output[i]);
+                engine->crypt(&output[i], ctx.keys, ctx.rounds, 1, &decrypted[i]);
+            }
+            for (unsigned int i = 0; i < 512; i++) {
+                expect(output[i] == expected[i] && decrypted[i] == plain_text[i],
+                       "%s engine, %u keys, block %u of round %" PRIu64, engine_names[e], key_count, i, round);
+            }
+        }
+    }
+}
+
+void verify_key_search(const verify_options *opts) {
+    // Plant a key in a random lane of a call at a random base, it must be the only match of the call
+    des_ctx ctx;
+    uint64_t key = 0;
+    des_init(&ctx, &key, 1, DES_MODE_ECB, 0);
+    LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+        if (des_set_engine(&ctx, engine_names[e]) != 0 || ctx.engine->search == NULL)
+            continue;
+        const engine *engine = ctx.engine;
+        uint64_t calls = opts->keys / engine->blocks;
+        for (uint64_t call = 0; call < calls; call++) {
+            uint64_t base = (next_random() >> 8) / engine->blocks * engine->blocks;
+            unsigned int lane = next_random() % engine->blocks;
+            uint64_t keys[16], plain_text = next_random(), cipher_text, matches[8];
+            des_generate_keys_reference(des_key_from_index(base + lane), keys);
+            des_encrypt_reference(plain_text, keys, &cipher_text);
+
+            engine->search(plain_text, cipher_text, base, matches);
+            char only = 1;
+            for (unsigned int g = 0; g < engine->blocks / 64; g++)
+                only &= matches[g] == (g == lane / 64 ? (uint64_t)1 << (lane % 64) : 0);
+            expect(only, "%s search, key index %014" PRIx64, engine_names[e], base + lane);
+        }
+    }
+}
+
+void verify_modes(const verify_options *opts) {
+    // Whole messages through des_encrypt_buffer in two pieces (so the chain carries over) on three threads,
+    // against the reference applied block by block
+    static uint64_t plain_text[12000], expected[12000];
+    static uint8_t bytes[12000 * 8];
+    des_set_threads(3);
+    uint64_t messages = opts->blocks / 65536 + 1;
+    for (uint64_t m = 0; m < messages; m++) {
+        uint64_t des_keys[3] = {next_random(), next_random(), next_random()}, keys[3][16];
+        unsigned int key_count = 1 + next_random() % 3;
+        reference_schedules(des_keys, key_count, keys);
+        block_mode mode = next_random() % 3;
+        uint64_t iv = next_random();
+        size_t length = 1 + next_random() % 12000, split = next_random() % (length + 1);
+
+        uint64_t chain = iv;
+        for (size_t i = 0; i < length; i++) {
+            plain_text[i] = next_random();
+            if (mode == DES_MODE_ECB) {
+                reference_crypt(plain_text[i], keys, key_count, 0, &expected[i]);
+            } else if (mode == DES_MODE_CBC) {
+                reference_crypt(plain_text[i] ^ chain, keys, key_count, 0, &expected[i]);
+                chain = expected[i];
+            } else {
+                reference_crypt(iv + i, keys, key_count, 0, &expected[i]);
+                expected[i] ^= plain_text[i];
+            }
+        }
+
+        des_ctx ctx;
+        des_init(&ctx, des_keys, key_count, mode, iv);
+        LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+            if (des_set_engine(&ctx, engine_names[e]) != 0)
+                continue;
+            for (size_t i = 0; i < length; i++)
+                des_store_block(plain_text[i], &bytes[i * 8]);
+
+            des_set_iv(&ctx, iv);
+            des_encrypt_buffer(&ctx, bytes, bytes, split * 8);
+            des_encrypt_buffer(&ctx, &bytes[split * 8], &bytes[split * 8], (length - split) * 8);
+            char same = 1;
+            for (size_t i = 0; i < length; i++)
+                same &= des_load_block(&bytes[i * 8]) == expected[i];
+            expect(same, "%s engine, mode %d, %u keys, %zu blocks split at %zu", engine_names[e], mode, key_count,
+                   length, split);
+
+            des_set_iv(&ctx, iv);
+            des_decrypt_buffer(&ctx, bytes, bytes, split * 8);
+            des_decrypt_buffer(&ctx, &bytes[split * 8], &bytes[split * 8], (length - split) * 8);
+            same = 1;
+            for (size_t i = 0; i < length; i++)
+                same &= des_load_block(&bytes[i * 8]) == plain_text[i];
+            expect(same, "%s engine, mode %d decryption, %zu blocks", engine_names[e], mode, length);
+        }
+    }
+    des_set_threads(1);
+}
+
+void verify_key_agile(const verify_options *opts) {
+    // Runs of blocks under a few keys, so both the cache hits and the engine path for long runs come up
+    static uint64_t des_keys[4096], plain_text[4096], output[4096];
+    static unsigned char key_numbers[4096];
+    uint64_t batches = opts->blocks / 65536 + 1;
+    for (uint64_t b = 0; b < batches; b++) {
+        uint64_t pool_keys[4] = {next_random(), next_random(), next_random(), next_random()}, keys[4][3][16];
+        LOOP(k, 4) {
+            reference_schedules(&pool_keys[k], 1, keys[k]);
+        }
+        size_t length = 1 + next_random() % 4096;
+        for (size_t i = 0; i < length;) {
+            size_t run = 1 + next_random() % (next_random() % 2 ? 8 : 300);
+            unsigned int key = next_random() % 4;
+            for (; run > 0 && i < length; run--, i++) {
+                key_numbers[i] = key;
+                des_keys[i] = pool_keys[key];
+                plain_text[i] = next_random();
+            }
+        }
+
+        schedule_cache cache = {0};
+        char decrypting = next_random() % 2;
+        des_crypt_key_blocks(des_keys, plain_text, decrypting, output, length, &cache);
+        for (size_t i = 0; i < length; i++) {
+            uint64_t expected;
+            reference_crypt(plain_text[i], keys[key_numbers[i]], 1, decrypting, &expected);
+            expect(output[i] == expected, "key-agile block %zu of %zu", i, length);
+        }
+    }
+}
+
+void verify_streams(const verify_options *opts) {
+    // Up to 700 CBC streams of random lengths (so several groups, tails and finished lanes) through des_*_streams
+    // on three threads, with the keys of the context, keys of their own or a mix, against the reference chains
+    enum { MAX_STREAMS = 700, MAX_STREAM_BLOCKS = 40 };
+    static uint64_t plain_text[MAX_STREAMS][MAX_STREAM_BLOCKS], expected[MAX_STREAMS][MAX_STREAM_BLOCKS];
+    static uint64_t stream_keys[MAX_STREAMS][3];
+    static uint8_t bytes[MAX_STREAMS][MAX_STREAM_BLOCKS * 8];
+    static des_stream streams[MAX_STREAMS];
+    des_set_threads(3);
+    uint64_t batches = opts->blocks / 65536 + 1;
+    for (uint64_t b = 0; b < batches; b++) {
+        uint64_t des_keys[3] = {next_random(), next_random(), next_random()}, keys[3][16];
+        unsigned int key_count = 1 + next_random() % 3, own_keys = next_random() % 3;
+        size_t count = 1 + next_random() % MAX_STREAMS;
+        for (size_t s = 0; s < count; s++) {
+            char own = own_keys == 2 ? next_random() % 2 : own_keys;
+            streams[s] = (des_stream){.input = bytes[s], .output = bytes[s], .iv = next_random(),
+                                      .nbytes = next_random() % (MAX_STREAM_BLOCKS + 1) * 8};
+            if (own) {
+                LOOP(k, 3) {
+                    stream_keys[s][k] = next_random();
+                }
+                streams[s].des_keys = stream_keys[s];
+                streams[s].key_count = key_count == 1 ? 1 : 2 + next_random() % 2;
+            }
+            reference_schedules(own ? stream_keys[s] : des_keys, own ? streams[s].key_count : key_count, keys);
+
+            uint64_t chain = streams[s].iv;
+            for (size_t i = 0; i < streams[s].nbytes / 8; i++) {
+                plain_text[s][i] = next_random();
+                reference_crypt(plain_text[s][i] ^ chain, keys, own ? streams[s].key_count : key_count, 0,
+                                &expected[s][i]);
+                chain = expected[s][i];
+            }
+        }
+
+        des_ctx ctx;
+        des_init(&ctx, des_keys, key_count, DES_MODE_CBC, 0);
+        LOOP(e, sizeof(engine_names) / sizeof(engine_names[0])) {
+            if (des_set_engine(&ctx, engine_names[e]) != 0)
+                continue;
+            for (size_t s = 0; s < count; s++) {
+                for (size_t i = 0; i < streams[s].nbytes / 8; i++)
+                    des_store_block(plain_text[s][i], &bytes[s][i * 8]);
+            }
+
+            des_encrypt_streams(&ctx, streams, count);
+            char same = 1;
+            for (size_t s = 0; s < count; s++) {
+                for (size_t i = 0; i < streams[s].nbytes / 8; i++)
+                    same &= des_load_block(&bytes[s][i * 8]) == expected[s][i];
+            }
+            expect(same, "%s engine, %zu streams, %u keys, own keys %u", engine_names[e], count, key_count,
+                   own_keys);
+
+            des_decrypt_streams(&ctx, streams, count);
+            same = 1;
+            for (size_t s = 0; s < count; s++) {
+                for (size_t i = 0; i < streams[s].nbytes / 8; i++)
+                    same &= des_load_block(&bytes[s][i * 8]) == plain_text[s][i];
+            }
+            expect(same, "%s engine, %zu streams decrypted, %u keys, own keys %u", engine_names[e], count,
+                   key_count, own_keys);
+        }
+    }
+    des_set_threads(1);
+}
+
+void verify_hex_codecs(const verify_options *opts) {
+    // Random text of hex digits in both cases, whole blocks, separators and junk bytes, fed to every codec in
+    // random pieces and compared with the scalar parser on the whole text
+    static char text[4096];
+    static uint64_t expected[4096 / 16], parsed[4096 / 16 + 1], blocks[256];
+    static const char separators[] = "\n\r \t,";
+    static const char digits[] = "0123456789abcdefABCDEF";
+    for (uint64_t round = 0; round < opts->files * 8; round++) {
+        size_t length = next_random() % sizeof(text);
+        for (size_t i = 0; i < length;) {
+            uint64_t r = next_random();
+            if (r % 8 == 0 && length - i >= 17) {
+                for (unsigned int j = 0; j < 16; j++)
+                    text[i++] = digits[next_random() % 16];
+                text[i++] = '\n';
+            } else if (r % 8 < 6) {
+                text[i++] = digits[(r >> 8) % 22];
+            } else if (r % 8 == 6) {
+                text[i++] = separators[(r >> 8) % 5];
+            } else {
+                text[i++] = (char)(r >> 8);
+            }
+        }
+
+        hex_parser whole = {0, 0};
+        size_t count = des_parse_hex_scalar(text, length, &whole, expected);
+        LOOP(c, sizeof(hex_codec_names) / sizeof(hex_codec_names[0])) {
+            const hex_codec *codec = des_find_hex_codec(hex_codec_names[c]);
+            if (codec == NULL)
+                continue;
+            hex_parser parser = {0, 0};
+            size_t got = 0;
+            for (size_t i = 0; i < length;) {
+                size_t piece = 1 + next_random() % (next_random() % 2 ? 40 : length);
+                if (piece > length - i)
+                    piece = length - i;
+                got += codec->parse(&text[i], piece, &parser, &parsed[got]);
+                i += piece;
+            }
+            expect(got == count && memcmp(parsed, expected, count * sizeof(uint64_t)) == 0 &&
+                   parser.digits == whole.digits && parser.block == whole.block,
+                   "%s parser, round %" PRIu64 " (%zu characters)", hex_codec_names[c], round, length);
+            expect(codec->count(text, length) == count * 16 + whole.digits, "%s digit count, round %" PRIu64,
+                   hex_codec_names[c], round);
+        }
+    }
+
+    // Encoding, and the round trip through the parser
+    for (uint64_t round = 0; round < opts->files; round++) {
+        size_t count = next_random() % 256;
+        static char encoded[256 * 16], reference[256 * 16];
+        for (size_t i = 0; i < count; i++)
+            blocks[i] = next_random();
+        des_encode_hex_scalar(blocks, count, reference);
+        LOOP(c, sizeof(hex_codec_names) / sizeof(hex_codec_names[0])) {
+            const hex_codec *codec = des_find_hex_codec(hex_codec_names[c]);
+            if (codec == NULL)
+                continue;
+            hex_parser parser = {0, 0};
+            codec->encode(blocks, count, encoded);
+            size_t got = codec->parse(encoded, count * 16, &parser, parsed);
+            expect(memcmp(encoded, reference, count * 16) == 0 && got == count &&
+                   memcmp(parsed, blocks, count * sizeof(uint64_t)) == 0, "%s encoder, %zu blocks",
+                   hex_codec_names[c], count);
+        }
+    }
+
+    // des_parse_hex_parallel on three threads over a few ranges' worth of text in two calls, starting from a random
+    // parser state. Runs of junk leave ranges with few or no digits, so blocks span several ranges.
+    enum { SPLIT_TEXT = 6 * HEX_RANGE_SIZE };
+    char *large = malloc(SPLIT_TEXT);
+    uint64_t *large_expected = malloc(SPLIT_TEXT / 16 * sizeof(uint64_t) + 8);
+    uint64_t *large_parsed = malloc(SPLIT_TEXT / 16 * sizeof(uint64_t) + 8);
+    if (large == NULL || large_expected == NULL || large_parsed == NULL) {
+        expect(0, "out of memory for the parallel parser");
+        free(large);
+        free(large_expected);
+        free(large_parsed);
+        return;
+    }
+    des_set_threads(3);
+    for (uint64_t round = 0; round < opts->files / 40 + 1; round++) {
+        size_t length = next_random() % SPLIT_TEXT;
+        for (size_t i = 0; i < length;) {
+            uint64_t r = next_random();
+            size_t run = r % 4 == 0 ? (r >> 8) % (2 * HEX_RANGE_SIZE) : (r >> 8) % 200;
+            if (run > length - i)
+                run = length - i;
+            char junk = r % 4 < 2;
+            for (size_t j = 0; j < run; j++, i++)
+                large[i] = junk ? separators[j % 5] : digits[(r >> (j % 48)) % 22];
+        }
+
+        unsigned int carried = next_random() % 16;
+        hex_parser whole = {carried ? next_random() >> (64 - 4 * carried) : 0, carried};
+        hex_parser parser = whole;
+        size_t split = next_random() % (length + 1);
+        size_t count = des_parse_hex_scalar(large, length, &whole, large_expected);
+        size_t got = des_parse_hex_parallel(large, split, &parser, large_parsed);
+        got += des_parse_hex_parallel(&large[split], length - split, &parser, &large_parsed[got]);
+        expect(got == count && memcmp(large_parsed, large_expected, count * sizeof(uint64_t)) == 0 &&
+               parser.digits == whole.digits && parser.block == whole.block,
+               "parallel parser, round %" PRIu64 " (%zu characters split at %zu, %u carried digits)", round, length,
+               split, carried);
+    }
+    des_set_threads(1);
+    free(large);
+    free(large_expected);
+    free(large_parsed);
+}
+
+void verify_readers(const verify_options *opts) {
+    // Encrypt random files to hex or containers, then damage some: flipped bytes, cut short, junk appended.
+    // Whole files must decrypt to the plaintext and ranges to their slice of it, damaged ones must fail cleanly
+    // or decrypt to something (a flipped digit can still leave valid padding), without crashing.
+    char directory[] = "/tmp/verify.XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("Error creating a scratch directory");
+        expect(0, "scratch directory");
+        return;
+    }
+    char plain_name[64], cipher_name[64], output_name[64];
+    snprintf(plain_name, sizeof(plain_name), "%s/plain", directory);
+    snprintf(cipher_name, sizeof(cipher_name), "%s/cipher", directory);
+    snprintf(output_name, sizeof(output_name), "%s/output", directory);
+
+    // The library reports damaged input on stderr, which would drown the results
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO), null_output = open("/dev/null", O_WRONLY);
+    dup2(null_output, STDERR_FILENO);
+
+    static uint8_t plain_text[20000], buffer[80000];
+    for (uint64_t f = 0; f < opts->files; f++) {
+        size_t length = next_random() % (next_random() % 4 == 0 ? sizeof(plain_text) : 200);
+        for (size_t i = 0; i < length; i++)
+            plain_text[i] = (uint8_t)next_random();
+        FILE *file = fopen(plain_name, "wb");
+        fwrite(plain_text, 1, length, file);
+        fclose(file);
+
+        uint64_t des_keys[3] = {next_random(), next_random(), next_random()};
+        unsigned int key_count = 1 + next_random() % 3;
+        des_ctx ctx;
+        des_init(&ctx, des_keys, key_count, next_random() % 3, next_random());
+        unsigned int flags = next_random() % 2 ? DES_CONTAINER : 0;
+        des_set_pipeline(next_random() % 3, next_random() % 2 ? 0 : 8 * (1 + next_random() % 1000));
+        if (des_encrypt_file(&ctx, plain_name, cipher_name, flags) != 0) {
+            expect(0, "encrypting file %" PRIu64, f);
+            continue;
+        }
+
+        // Damage the ciphertext (or wrap the hex in lines, which must still decrypt)
+        file = fopen(cipher_name, "rb");
+        size_t cipher_length = fread(buffer, 1, sizeof(buffer) / 2, file);
+        fclose(file);
+        unsigned int damage = next_random() % 8;
+        if (damage == 1 && cipher_length > 0) {
+            for (unsigned int n = 1 + next_random() % 4; n > 0; n--)
+                buffer[next_random() % cipher_length] ^= (uint8_t)(1 + next_random() % 255);
+        } else if (damage == 2 && cipher_length > 0) {
+            cipher_length = next_random() % cipher_length;
+        } else if (damage == 3) {
+            for (unsigned int n = 1 + next_random() % 40; n > 0; n--)
+                buffer[cipher_length++] = (uint8_t)next_random();
+        } else if (damage == 4 && !flags) {
+            // Line breaks every so often: not damage, hex allows separators anywhere
+            size_t line = 1 + next_random() % 80, wrapped = 0;
+            static uint8_t lines[80000];
+            for (size_t i = 0; i < cipher_length; i++) {
+                lines[wrapped++] = buffer[i];
+                if (i % line == line - 1)
+                    lines[wrapped++] = '\n';
+            }
+            memcpy(buffer, lines, wrapped);
+            cipher_length = wrapped;
+        } else if (damage == 7 && !flags && cipher_length > 2 * 4096) {
+            // Lines longer than a page, then line breaks up to a multiple of 16: nothing in the first page or
+            // the last 16 bytes gives the separators away, so ranges must not be read by offset
+            size_t line = 4097 + next_random() % 4096, wrapped = 0;
+            static uint8_t lines[80000];
+            for (size_t i = 0; i < cipher_length; i++) {
+                lines[wrapped++] = buffer[i];
+                if (i % line == line - 1)
+                    lines[wrapped++] = '\n';
+            }
+            while (wrapped % 16 != 0)
+                lines[wrapped++] = '\n';
+            memcpy(buffer, lines, wrapped);
+            cipher_length = wrapped;
+        } else if (damage == 6 && cipher_length >= CONTAINER_HEADER_SIZE) {
+            // One header field (chunk size, plaintext length, chunk count or index offset) set to something odd
+            static const unsigned char fields[] = {12, 24, 32, 40};
+            static const uint64_t odd_values[] = {0, 1, 8, 0xFFFFFFFFFFFFFFF8, 0x8000000000000000, 0xFFFFFFFF};
+            unsigned char field = fields[next_random() % 4];
+            uint64_t value = next_random() % 2 ? odd_values[next_random() % 6] : next_random() % 4096;
+            if (field == 12)
+                value <<= 32;
+            uint8_t bytes[8];
+            des_store_block(value, bytes);
+            memcpy(&buffer[field], bytes, field == 12 ? 4 : 8);
+        }
+        char intact = damage == 0 || damage == 5 || ((damage == 4 || damage == 7) && !flags);
+        file = fopen(cipher_name, "wb");
+        fwrite(buffer, 1, cipher_length, file);
+        fclose(file);
+
+        unsigned int flags_in = next_random() % 2 ? DES_MMAP : 0;
+        int status = des_decrypt_file(&ctx, cipher_name, output_name, flags_in);
+        file = fopen(output_name, "rb");
+        size_t output_length = file != NULL ? fread(buffer, 1, sizeof(buffer), file) : 0;
+        if (file != NULL)
+            fclose(file);
+        if (intact)
+            expect(status == 0 && output_length == length && memcmp(buffer, plain_text, length) == 0,
+                   "decrypting file %" PRIu64 " (%zu bytes, %s, mode %d)", f, length, flags ? "container" : "hex",
+                   ctx.mode);
+
+        // The key check value must turn away a container under another key (bit 1 of a byte is a key bit, bit 0
+        // only parity)
+        if (intact && flags) {
+            uint64_t wrong_keys[3] = {des_keys[0] ^ 2, des_keys[1], des_keys[2]};
+            des_ctx wrong;
+            des_init(&wrong, wrong_keys, key_count, ctx.mode, ctx.iv);
+            expect(des_decrypt_file(&wrong, cipher_name, output_name, flags_in) != 0,
+                   "container %" PRIu64 " decrypting under a wrong key", f);
+        }
+
+        // A random range, which must be the same slice of the plaintext
+        uint64_t offset = next_random() % (length + 8), range = next_random() % (length + 8);
+        status = des_decrypt_range(&ctx, cipher_name, output_name, offset, range);
+        file = fopen(output_name, "rb");
+        output_length = file != NULL ? fread(buffer, 1, sizeof(buffer), file) : 0;
+        if (file != NULL)
+            fclose(file);
+        if (intact) {
+            size_t from = offset < length ? offset : length;
+            size_t to = range < length - from ? from + range : length;
+            expect(status == 0 && output_length == to - from && memcmp(buffer, &plain_text[from], to - from) == 0,
+                   "range [%" PRIu64 ", +%" PRIu64 ") of file %" PRIu64, offset, range, f);
+        } else {
+            checks++;   // survived
+        }
+    }
+    des_set_pipeline(PIPELINE_DEPTH, 0);
+
+    // A batch whose inputs share a name: a/x and b/x would both write out/x, so both must fail and a/y go through
+    char paths[6][96];
+    static const char *const names[] = {"a", "b", "a/x", "b/x", "a/y", "out"};
+    LOOP(i, 6) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%s", directory, names[i]);
+        if (i < 2)
+            mkdir(paths[i], 0777);
+    }
+    FILE *manifest = fopen(plain_name, "w");
+    for (unsigned int i = 2; i < 5; i++) {
+        FILE *file = fopen(paths[i], "wb");
+        fwrite(plain_text, 1, 100, file);
+        fclose(file);
+        fprintf(manifest, "%s\n", paths[i]);
+    }
+    fclose(manifest);
+    des_ctx ctx;
+    uint64_t des_key = next_random();
+    des_init(&ctx, &des_key, 1, DES_MODE_ECB, 0);
+    des_batch_stats stats;
+    char out_x[112], out_y[112];
+    snprintf(out_x, sizeof(out_x), "%s/x", paths[5]);
+    snprintf(out_y, sizeof(out_y), "%s/y", paths[5]);
+    expect(des_encrypt_batch(&ctx, plain_name, paths[5], &stats) != 0 && stats.files == 1 && stats.failed == 2 &&
+           access(out_x, F_OK) != 0 && access(out_y, F_OK) == 0, "batch with colliding output names");
+    unlink(out_y);
+    for (unsigned int i = 6; i-- > 0;) {
+        if (i < 2 || i == 5)
+            rmdir(paths[i]);
+        else
+            unlink(paths[i]);
+    }
+
+    // A file encrypted or decrypted onto itself must be refused and left as it was
+    static const unsigned int in_place_flags[] = {0, DES_CONTAINER, DES_MMAP};
+    LOOP(i, 2 * sizeof(in_place_flags) / sizeof(in_place_flags[0])) {
+        unsigned int flags = in_place_flags[i / 2];
+        char decrypting = i % 2;
+        FILE *file = fopen(plain_name, "wb");
+        fwrite(plain_text, 1, 1000, file);
+        fclose(file);
+        if (decrypting && (des_encrypt_file(&ctx, plain_name, cipher_name, flags & DES_CONTAINER) != 0 ||
+                           rename(cipher_name, plain_name) != 0)) {
+            expect(0, "encrypting a file to decrypt in place");
+            continue;
+        }
+        file = fopen(plain_name, "rb");
+        size_t before = fread(buffer, 1, sizeof(buffer) / 2, file);
+        fclose(file);
+        int status = decrypting ? des_decrypt_file(&ctx, plain_name, plain_name, flags & DES_MMAP)
+                                : des_encrypt_file(&ctx, plain_name, plain_name, flags);
+        file = fopen(plain_name, "rb");
+        size_t after = fread(&buffer[sizeof(buffer) / 2], 1, sizeof(buffer) / 2, file);
+        fclose(file);
+        expect(status != 0 && after == before && memcmp(buffer, &buffer[sizeof(buffer) / 2], before) == 0,
+               "%s a file onto itself (flags %u)", decrypting ? "decrypting" : "encrypting", flags);
+    }
+
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(null_output);
+    unlink(plain_name);
+    unlink(cipher_name);
+    unlink(output_name);
+    rmdir(directory);
+}